@@ -0,0 +1,137 @@
+/** @file bench_multiqueue.c
+ *
+ * Measures how multiqueue_t throughput scales with threads. Every thread
+ * polls one element and offers it back with a new key, so the queue keeps
+ * its size; the strict (one shard) and relaxed (four shards per thread)
+ * flavours are both timed. Results are printed as CSV.
+ *
+ * Usage: ./bench_multiqueue [max threads] [operations per thread] [queue size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "libmultiqueue/libmultiqueue.h"
+
+#define SHARDS_PER_THREAD 4
+
+typedef struct _item_t
+{
+	unsigned int key;
+} item_t;
+
+typedef struct _worker_t
+{
+	multiqueue_t *queue;
+	pthread_barrier_t *start;
+	long ops;
+	long done; //polls that found an element
+	unsigned int seed;
+} worker_t;
+
+
+static int compare_items(const void *a, const void *b)
+{
+	unsigned int ka = ((const item_t *) a)->key, kb = ((const item_t *) b)->key;
+	return (ka > kb) - (ka < kb);
+}
+
+
+static double now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+static void *work(void *arg)
+{
+	worker_t *w = (worker_t *) arg;
+	long i;
+	item_t *item;
+
+	pthread_barrier_wait(w->start);
+
+	for(i = 0; i < w->ops; i++) {
+		item = (item_t *) multiqueue_poll(w->queue);
+		if(!item)
+			continue;
+		w->done++;
+
+		//Keys only move forward, as arrival times do in the scheduler.
+		item->key += 1 + rand_r(&w->seed) % 1024;
+		multiqueue_offer(w->queue, item);
+	}
+
+	return NULL;
+}
+
+
+//Times one run and prints its CSV row.
+static void run(int threads, int shards, long ops, int size)
+{
+	multiqueue_t queue;
+	pthread_barrier_t start;
+	pthread_t *tids = (pthread_t *) malloc(sizeof(pthread_t) * threads);
+	worker_t *workers = (worker_t *) malloc(sizeof(worker_t) * threads);
+	item_t *items = (item_t *) malloc(sizeof(item_t) * size);
+	unsigned int seed = 1;
+	int i;
+	long done = 0;
+	double began, elapsed;
+
+	multiqueue_init(&queue, compare_items, shards);
+	for(i = 0; i < size; i++) {
+		items[i].key = rand_r(&seed) % 65536;
+		multiqueue_offer(&queue, &items[i]);
+	}
+
+	pthread_barrier_init(&start, NULL, threads + 1);
+	for(i = 0; i < threads; i++) {
+		workers[i].queue = &queue;
+		workers[i].start = &start;
+		workers[i].ops = ops;
+		workers[i].done = 0;
+		workers[i].seed = i + 1;
+		pthread_create(&tids[i], NULL, work, &workers[i]);
+	}
+
+	pthread_barrier_wait(&start);
+	began = now_ns();
+	for(i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+	elapsed = now_ns() - began;
+
+	//Each operation is one poll that found an element and one offer; a
+	//poll that came back empty is not counted.
+	for(i = 0; i < threads; i++)
+		done += workers[i].done;
+	printf("%d,%d,%d,%ld,%.1f,%.3f\n", threads, shards, size, done,
+		elapsed / done, done / elapsed * 1e3);
+
+	pthread_barrier_destroy(&start);
+	multiqueue_destroy(&queue);
+	free(items);
+	free(workers);
+	free(tids);
+}
+
+
+int main(int argc, char **argv)
+{
+	int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+	long ops = argc > 2 ? atol(argv[2]) : 1000000;
+	int size = argc > 3 ? atoi(argv[3]) : 100000;
+	int threads;
+
+	printf("threads,shards,size,ops,ns_per_op,mops_per_s\n");
+	for(threads = 1; threads <= max_threads; threads *= 2) {
+		run(threads, 1, ops, size);
+		run(threads, SHARDS_PER_THREAD * threads, ops, size);
+	}
+
+	return 0;
+}
@@ -0,0 +1,245 @@
+/** @file bench_priqueue.c
+ *
+ * Measures priqueue_t on the scheduler's own jobs. For every queue
+ * configuration, key pattern and size it fills a queue by offering, then
+ * times priqueue_at(), priqueue_remove_at(), priqueue_remove() and
+ * finally drains it by polling. Results are printed as CSV: the time and
+ * the number of allocations per operation.
+ *
+ * Usage: ./bench_priqueue [max size] [min size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "libscheduler/libscheduler.h"
+//The scheduler's job_t and key functions, exactly as it uses them.
+#include "libscheduler/scheduler_internal.h"
+
+/**
+  How many element visits one measurement of at(), remove_at() or remove()
+  may cost, as a multiple of the queue size; the linear ones get fewer
+  operations on large queues.
+*/
+#define BENCH_BUDGET 100000000L
+
+/**
+  Sizes whose fill would take longer than this, judged from how the cost
+  of an offer grew over the sizes before, are skipped for that
+  configuration and pattern.
+*/
+#define BENCH_SKIP_NS 20e9
+
+//Calls to the allocator, counted by the linker wrappers below.
+static long allocations;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+  allocations++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+  allocations++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+  allocations++;
+  return __real_realloc(ptr, size);
+}
+
+/**
+  How the keys of a queue's jobs are laid out. WIDE is RANDOM without
+  folding PRI's priorities into its buckets, so it is only run for PRI.
+*/
+typedef enum {RANDOM = 0, SORTED, REVERSE, SAME, WIDE} pattern_t;
+static const char *pattern_names[] = {"random", "sorted", "reverse", "fifo", "wide"};
+
+//The priorities of the WIDE pattern run from 0 to this.
+#define WIDE_PRIORITIES 1000000
+
+/**
+  A queue as one of the schemes might set it up: its engine, and the key
+  it orders jobs by.
+*/
+typedef struct _config_t {
+  const char *engine;
+  scheme_t scheme;
+  priqueue_kind_t kind;
+} config_t;
+
+static const char *scheme_names[] = {"fcfs", "sjf", "psjf", "pri", "ppri", "rr"};
+
+//The scheduler's own choices come first for every scheme.
+static const config_t configs[] = {
+  {"bucket", FCFS, PRIQUEUE_BUCKET},
+  {"tree",   FCFS, PRIQUEUE_TREE},
+  {"heap",   FCFS, PRIQUEUE_HEAP},
+  {"tree",   SJF,  PRIQUEUE_TREE},
+  {"heap",   SJF,  PRIQUEUE_HEAP},
+  {"bucket", PRI,  PRIQUEUE_BUCKET},
+  {"tree",   PRI,  PRIQUEUE_TREE},
+  {"heap",   PRI,  PRIQUEUE_HEAP},
+  {"fifo",   RR,   PRIQUEUE_FIFO},
+};
+
+static void config_init(const config_t *c, priqueue_t *q)
+{
+  if(c->kind == PRIQUEUE_BUCKET)
+    priqueue_init_bucket(q, NULL, c->scheme == PRI ? bucket3 : NULL, c->scheme == PRI ? PRIORITY_BUCKETS : 1);
+  else
+    priqueue_init_kind(q, NULL, c->kind);
+
+  switch(c->scheme) {
+    case FCFS: priqueue_set_key(q, key0); break;
+    case SJF: priqueue_set_keys(q, key1, key0); break;
+    case PRI: priqueue_set_keys(q, key3, key0); break;
+    default: break;
+  }
+}
+
+/**
+  Fills in job i of n so that the field the scheme orders by follows the
+  pattern; arrival times otherwise increase, as they do in the simulator.
+*/
+static void job_fill(job_t *job, const config_t *c, pattern_t p, int i, int n)
+{
+  long long v;
+
+  switch(p) {
+    case RANDOM: v = rand(); break;
+    case WIDE: v = rand() % (WIDE_PRIORITIES + 1); break;
+    case SORTED: v = i; break;
+    case REVERSE: v = n - i; break;
+    default: v = 0; break;
+  }
+
+  job->job_number = i;
+  job->time = c->scheme == FCFS ? (int) v : i;
+  job->running_time = c->scheme == SJF ? (int) v : 1;
+  if(c->scheme != PRI)
+    job->priority = 0;
+  else if(p == WIDE)
+    job->priority = (int) v;
+  else
+    job->priority = (int)(p == RANDOM ? v % PRIORITY_BUCKETS : v * PRIORITY_BUCKETS / (n + 1));
+}
+
+static double now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//The start of the measurement in progress.
+static double began;
+static long began_allocations;
+
+static void start()
+{
+  began_allocations = allocations;
+  began = now_ns();
+}
+
+//Ends the measurement in progress and prints its row; returns its ns/op.
+static double finish(const config_t *c, pattern_t p, int n, const char *op, long ops)
+{
+  double ns = now_ns() - began;
+  long allocs = allocations - began_allocations;
+
+  if(ops < 1)
+    ops = 1;
+  printf("%s,%s,%s,%d,%s,%ld,%.1f,%.4f\n", c->engine, scheme_names[c->scheme], pattern_names[p],
+    n, op, ops, ns / ops, (double) allocs / ops);
+  fflush(stdout);
+
+  return ns / ops;
+}
+
+//Runs every measurement on one queue of n jobs; returns the ns per offer.
+static double bench(const config_t *c, pattern_t p, int n)
+{
+  priqueue_t q;
+  job_t *jobs = (job_t *) malloc(sizeof(job_t) * n);
+  int i, m, size;
+  double offer_ns;
+  volatile void *sink;
+
+  srand(1);
+  for(i = 0; i < n; i++)
+    job_fill(&jobs[i], c, p, i, n);
+
+  config_init(c, &q);
+
+  start();
+  for(i = 0; i < n; i++)
+    priqueue_offer(&q, &jobs[i]);
+  offer_ns = finish(c, p, n, "offer", n);
+
+  //The linear operations get fewer tries on larger queues.
+  m = n / 2;
+  if(m > BENCH_BUDGET / n)
+    m = BENCH_BUDGET / n > 10 ? BENCH_BUDGET / n : 10;
+
+  start();
+  for(i = 0; i < m; i++)
+    sink = priqueue_at(&q, rand() % n);
+  finish(c, p, n, "at", m);
+
+  start();
+  for(i = 0; i < m; i++)
+    sink = priqueue_remove_at(&q, rand() % priqueue_size(&q));
+  finish(c, p, n, "remove_at", m);
+
+  //Some of the jobs asked for were removed already; they are looked for all the same.
+  start();
+  for(i = 0; i < m; i++)
+    priqueue_remove(&q, &jobs[rand() % n]);
+  finish(c, p, n, "remove", m);
+
+  size = priqueue_size(&q);
+  start();
+  while(priqueue_size(&q))
+    sink = priqueue_poll(&q);
+  finish(c, p, n, "poll", size);
+
+  (void) sink;
+  priqueue_destroy(&q);
+  free(jobs);
+
+  return offer_ns;
+}
+
+int main(int argc, char **argv)
+{
+  int max_size = argc > 1 ? atoi(argv[1]) : 10000000;
+  int min_size = argc > 2 ? atoi(argv[2]) : 100;
+  unsigned int c;
+  int p, n;
+  double offer_ns, last_ns, growth;
+
+  printf("engine,scheme,pattern,size,op,ops,ns_per_op,allocs_per_op\n");
+  for(c = 0; c < sizeof(configs) / sizeof(configs[0]); c++)
+    for(p = RANDOM; p <= WIDE; p++) {
+      if(p == WIDE && configs[c].scheme != PRI)
+        continue;
+      for(n = min_size, offer_ns = 0, growth = 1; n <= max_size; n *= 10) {
+        if(offer_ns * growth * n > BENCH_SKIP_NS)
+          break;
+        last_ns = offer_ns;
+        offer_ns = bench(&configs[c], (pattern_t) p, n);
+        growth = last_ns > 0 && offer_ns > last_ns ? offer_ns / last_ns : 1;
+      }
+    }
+
+  return 0;
+}
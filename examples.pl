@@ -14,5 +14,14 @@ for $file (<examples/*>){
 		}
 	}
 }
+#files the simulator must refuse rather than run
+for $file (<examples/bad-*.csv>){
+	$output = `timeout 10 ./simulator -c 1 -s fcfs $file 2>&1`;
+	$status = $? >> 8;
+	if($status != 2 || $output ne "Illegal file format.\n"){
+		($first) = split /\n/, $output;
+		print "Test file $file was not refused (exit $status)\n$first\n";
+	}
+}
 #cleanup
 `rm output1 output2`;
@@ -0,0 +1,132 @@
+/** @file libhistogram.c
+ */
+
+#include "libhistogram.h"
+
+
+//The bucket that counts value.
+static int bucket_of(long long value)
+{
+	int top, shift;
+
+	if(value < HISTOGRAM_SUB)
+		return (int) value;
+
+	//Keep the leading HISTOGRAM_SUB_BITS bits; the top one is always set.
+	top = 63 - __builtin_clzll((unsigned long long) value);
+	shift = top - (HISTOGRAM_SUB_BITS - 1);
+	return HISTOGRAM_SUB + (top - HISTOGRAM_SUB_BITS) * (HISTOGRAM_SUB / 2)
+		+ (int)(value >> shift) - HISTOGRAM_SUB / 2;
+}
+
+
+//The largest value that bucket counts.
+static long long bucket_high(int bucket)
+{
+	int sub, shift;
+
+	if(bucket < HISTOGRAM_SUB)
+		return bucket;
+
+	bucket -= HISTOGRAM_SUB;
+	sub = bucket % (HISTOGRAM_SUB / 2) + HISTOGRAM_SUB / 2;
+	shift = bucket / (HISTOGRAM_SUB / 2) + 1;
+	return (long long)((((unsigned long long) sub + 1) << shift) - 1);
+}
+
+
+/**
+  Initializes the histogram_t data structure, with nothing counted.
+
+  @param h a pointer to an instance of the histogram_t data structure
+ */
+void histogram_init(histogram_t *h)
+{
+	int i;
+
+	for(i = 0; i < HISTOGRAM_BUCKETS; i++)
+		h->counts[i] = 0;
+	h->count = h->max = 0;
+}
+
+
+/**
+  Counts one value.
+
+  @param h a pointer to an instance of the histogram_t data structure
+  @param value the value to count; negative values are counted as 0
+ */
+void histogram_record(histogram_t *h, long long value)
+{
+	if(value < 0)
+		value = 0;
+
+	h->counts[bucket_of(value)]++;
+	h->count++;
+	if(value > h->max)
+		h->max = value;
+}
+
+
+/**
+  Returns the value that the given percentage of the counted values are
+  at or below.
+
+  Values below HISTOGRAM_SUB are exact; larger ones are the top of the
+  bucket they fall in, which is at most 1/64th too high, and never above
+  the largest value counted.
+
+  @param h a pointer to an instance of the histogram_t data structure
+  @param percentile a percentage from 0 to 100; 100 gives the largest value
+  @return the value at that percentile
+  @return 0 if nothing has been counted
+ */
+long long histogram_percentile(histogram_t *h, double percentile)
+{
+	long long rank, seen = 0;
+	int i;
+
+	if(!h->count)
+		return 0;
+
+	//The rank of the value wanted, from 1 to count, rounded up.
+	rank = (long long)(percentile / 100 * h->count);
+	if(rank < percentile / 100 * h->count)
+		rank++;
+	if(rank < 1)
+		rank = 1;
+	if(rank >= h->count)
+		return h->max;
+
+	for(i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		seen += h->counts[i];
+		if(seen >= rank)
+			break;
+	}
+
+	return bucket_high(i) < h->max ? bucket_high(i) : h->max;
+}
+
+
+/**
+  Returns the number of values counted.
+
+  @param h a pointer to an instance of the histogram_t data structure
+  @return the number of values counted
+ */
+long long histogram_count(histogram_t *h)
+{
+	return h->count;
+}
+
+
+/**
+  Returns the largest value counted.
+
+  @param h a pointer to an instance of the histogram_t data structure
+  @return the largest value counted, or 0 if nothing has been counted
+ */
+long long histogram_max(histogram_t *h)
+{
+	return h->max;
+}
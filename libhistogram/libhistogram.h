@@ -0,0 +1,36 @@
+/** @file libhistogram.h
+ */
+
+#ifndef LIBHISTOGRAM_H_
+#define LIBHISTOGRAM_H_
+
+/**
+  Values below this are counted exactly; each power of two above it is
+  split into half as many buckets, so a bucket is never wider than
+  1/64th of the values it holds.
+*/
+#define HISTOGRAM_SUB_BITS 7
+#define HISTOGRAM_SUB (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS (HISTOGRAM_SUB + (63 - HISTOGRAM_SUB_BITS) * (HISTOGRAM_SUB / 2))
+
+/**
+  Histogram Data Structure
+
+  Counts non-negative values in log-linear buckets, in the manner of an
+  HDR histogram: recording is constant time, and any percentile can be
+  read back to within the width of one bucket.
+*/
+typedef struct _histogram_t
+{
+	long long counts[HISTOGRAM_BUCKETS];
+	long long count;
+	long long max;
+} histogram_t;
+
+void      histogram_init      (histogram_t *h);
+void      histogram_record    (histogram_t *h, long long value);
+long long histogram_percentile(histogram_t *h, double percentile);
+long long histogram_count     (histogram_t *h);
+long long histogram_max       (histogram_t *h);
+
+#endif /* LIBHISTOGRAM_H_ */
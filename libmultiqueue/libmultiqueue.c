@@ -0,0 +1,241 @@
+/** @file libmultiqueue.c
+ */
+
+#include <stdlib.h>
+
+#include "libmultiqueue.h"
+
+//Per-thread state of the generator that picks shards.
+static __thread unsigned int shard_seed;
+
+
+//Picks a shard uniformly at random with a per-thread xorshift generator.
+static int random_shard(multiqueue_t *q)
+{
+	unsigned int x = shard_seed;
+
+	//Every thread's copy of the seed lives at a different address.
+	if(!x)
+		x = (unsigned int)(size_t) &shard_seed | 1;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	shard_seed = x;
+
+	return (int)(x % (unsigned int) q->num_shards);
+}
+
+
+//Whether shard a's head should leave before shard b's; an empty shard never should.
+static int shard_before(multiqueue_t *q, multiqueue_shard_t *a, multiqueue_shard_t *b)
+{
+	void *ha = priqueue_peek(&a->queue), *hb = priqueue_peek(&b->queue);
+
+	if(!ha)
+		return 0;
+	if(!hb)
+		return 1;
+	return !q->comparitor || q->comparitor(ha, hb) <= 0;
+}
+
+
+/**
+  Initializes the multiqueue_t data structure.
+
+  Assumtions
+    - You may assume this function will only be called once per instance of multiqueue_t
+    - You may assume this function will be the first function called using an instance of multiqueue_t.
+    - No other thread uses q until this function returns.
+  @param q a pointer to an instance of the multiqueue_t data structure
+  @param comparer a function pointer that compares two elements, as for priqueue_init()
+  @param shards the number of lock-protected queues to spread elements over;
+  a few per thread using q keeps contention low, and 1 makes q strict
+ */
+void multiqueue_init(multiqueue_t *q, int(*comparer)(const void *, const void *), int shards)
+{
+	int i;
+
+	q->num_shards = shards > 0 ? shards : 1;
+	q->shards = (multiqueue_shard_t *) aligned_alloc(sizeof(multiqueue_shard_t), sizeof(multiqueue_shard_t) * q->num_shards);
+	q->size = 0;
+	q->comparitor = comparer;
+
+	//Shards only ever serve their heads, which is what the heap is best at.
+	for(i = 0; i < q->num_shards; i++) {
+		pthread_mutex_init(&q->shards[i].lock, NULL);
+		priqueue_init_kind(&q->shards[i].queue, comparer, PRIQUEUE_HEAP);
+	}
+}
+
+
+/**
+  Inserts the specified element into this multiqueue.
+
+  The element goes to a random shard, trying others before waiting on a
+  lock that another thread holds.
+
+  @param q a pointer to an instance of the multiqueue_t data structure
+  @param ptr a pointer to the data to be inserted into the multiqueue
+ */
+void multiqueue_offer(multiqueue_t *q, void *ptr)
+{
+	int attempt;
+	multiqueue_shard_t *shard = NULL;
+
+	for(attempt = 0; attempt < q->num_shards; attempt++) {
+		shard = &q->shards[random_shard(q)];
+		if(pthread_mutex_trylock(&shard->lock) == 0)
+			break;
+		shard = NULL;
+	}
+
+	if(!shard) {
+		shard = &q->shards[random_shard(q)];
+		pthread_mutex_lock(&shard->lock);
+	}
+
+	priqueue_offer(&shard->queue, ptr);
+	__atomic_add_fetch(&q->size, 1, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&shard->lock);
+}
+
+
+/**
+  Retrieves, but does not remove, the head of this multiqueue, returning
+  NULL if this multiqueue is empty.
+
+  Every shard is looked at in turn, so the result is only exact while no
+  other thread changes the multiqueue, and only safe to use while no other
+  thread can poll and free the element.
+
+  @param q a pointer to an instance of the multiqueue_t data structure
+  @return pointer to element at the head of the multiqueue
+  @return NULL if the multiqueue is empty
+ */
+void *multiqueue_peek(multiqueue_t *q)
+{
+	int i;
+	void *best = NULL, *head;
+
+	for(i = 0; i < q->num_shards; i++) {
+		pthread_mutex_lock(&q->shards[i].lock);
+		head = priqueue_peek(&q->shards[i].queue);
+		if(head && (!best || (q->comparitor && q->comparitor(head, best) < 0)))
+			best = head;
+		pthread_mutex_unlock(&q->shards[i].lock);
+	}
+
+	return best;
+}
+
+
+/**
+  Retrieves and removes an element at or near the head of this multiqueue.
+
+  Two random shards are locked, in order so that two polls can never wait
+  on each other, and the better of their heads is taken. If both are empty
+  every shard is swept in turn, so NULL is only returned when the whole
+  multiqueue was found empty.
+
+  @param q a pointer to an instance of the multiqueue_t data structure
+  @return an element at or near the head of the multiqueue
+  @return NULL if the multiqueue is empty
+ */
+void *multiqueue_poll(multiqueue_t *q)
+{
+	int i, a, b;
+	void *ptr = NULL;
+
+	if(__atomic_load_n(&q->size, __ATOMIC_ACQUIRE) == 0)
+		return NULL;
+
+	a = random_shard(q);
+	b = random_shard(q);
+	if(a > b) {
+		i = a;
+		a = b;
+		b = i;
+	}
+
+	pthread_mutex_lock(&q->shards[a].lock);
+	if(b != a)
+		pthread_mutex_lock(&q->shards[b].lock);
+
+	if(shard_before(q, &q->shards[b], &q->shards[a]))
+		ptr = priqueue_poll(&q->shards[b].queue);
+	else
+		ptr = priqueue_poll(&q->shards[a].queue);
+
+	if(b != a)
+		pthread_mutex_unlock(&q->shards[b].lock);
+	pthread_mutex_unlock(&q->shards[a].lock);
+
+	for(i = 0; !ptr && i < q->num_shards; i++) {
+		pthread_mutex_lock(&q->shards[i].lock);
+		ptr = priqueue_poll(&q->shards[i].queue);
+		pthread_mutex_unlock(&q->shards[i].lock);
+	}
+
+	if(ptr)
+		__atomic_sub_fetch(&q->size, 1, __ATOMIC_RELEASE);
+
+	return ptr;
+}
+
+
+/**
+  Removes all instances of ptr from the multiqueue.
+
+  @param q a pointer to an instance of the multiqueue_t data structure
+  @param ptr address of element to be removed
+  @return the number of entries removed
+ */
+int multiqueue_remove(multiqueue_t *q, void *ptr)
+{
+	int i, removed = 0;
+
+	for(i = 0; i < q->num_shards; i++) {
+		pthread_mutex_lock(&q->shards[i].lock);
+		removed += priqueue_remove(&q->shards[i].queue, ptr);
+		pthread_mutex_unlock(&q->shards[i].lock);
+	}
+
+	__atomic_sub_fetch(&q->size, removed, __ATOMIC_RELEASE);
+	return removed;
+}
+
+
+/**
+  Returns the number of elements in the multiqueue.
+
+  @param q a pointer to an instance of the multiqueue_t data structure
+  @return the number of elements in the multiqueue, as of some moment during the call
+ */
+int multiqueue_size(multiqueue_t *q)
+{
+	return __atomic_load_n(&q->size, __ATOMIC_ACQUIRE);
+}
+
+
+/**
+  Destroys and frees all the memory associated with q.
+
+  @param q a pointer to an instance of the multiqueue_t data structure,
+  which no other thread may still be using
+ */
+void multiqueue_destroy(multiqueue_t *q)
+{
+	int i;
+
+	for(i = 0; i < q->num_shards; i++) {
+		priqueue_destroy(&q->shards[i].queue);
+		pthread_mutex_destroy(&q->shards[i].lock);
+	}
+
+	free(q->shards);
+	q->shards = NULL;
+	q->num_shards = 0;
+	q->size = 0;
+}
@@ -0,0 +1,54 @@
+/** @file libmultiqueue.h
+ */
+
+#ifndef LIBMULTIQUEUE_H_
+#define LIBMULTIQUEUE_H_
+
+#include <pthread.h>
+
+#include "../libpriqueue/libpriqueue.h"
+
+/**
+  One lock-protected queue of a multiqueue_t, padded to a cache line of
+  its own so that threads working on neighbouring shards do not contend.
+*/
+typedef struct _multiqueue_shard_t {
+	pthread_mutex_t lock;
+	priqueue_t queue;
+} __attribute__((aligned(64))) multiqueue_shard_t;
+
+/**
+  Multiqueue Data Structure
+
+  A priority queue that any number of threads may offer to and poll from
+  at once. Elements are spread over several shards, each a priqueue_t
+  behind its own lock: an offer goes to a random shard, and a poll takes
+  the better head of two random shards. A poll therefore returns an
+  element close to, but not always exactly, the head of the whole queue,
+  and elements that compare equal may leave in any order. With a single
+  shard the queue is strict, and as fast as one lock allows.
+
+  Unlike priqueue_t there is no multiqueue_at() or multiqueue_remove_at():
+  the shards keep no order between them, so an element has no rank in the
+  whole queue, and one found by rank could leave before it was used.
+  multiqueue_remove() takes an element out by pointer instead.
+*/
+typedef struct _multiqueue_t
+{
+	multiqueue_shard_t *shards;
+	int num_shards;
+	int size; //only read and written atomically
+	int(*comparitor)(const void *, const void *);
+} multiqueue_t;
+
+void   multiqueue_init    (multiqueue_t *q, int(*comparer)(const void *, const void *), int shards);
+
+void   multiqueue_offer   (multiqueue_t *q, void *ptr);
+void * multiqueue_peek    (multiqueue_t *q);
+void * multiqueue_poll    (multiqueue_t *q);
+int    multiqueue_remove  (multiqueue_t *q, void *ptr);
+int    multiqueue_size    (multiqueue_t *q);
+
+void   multiqueue_destroy (multiqueue_t *q);
+
+#endif /* LIBMULTIQUEUE_H_ */
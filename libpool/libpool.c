@@ -0,0 +1,104 @@
+/** @file libpool.c
+ */
+
+#include <stdlib.h>
+
+#include "libpool.h"
+
+/**
+  The largest chunk a pool will allocate, in slots.
+*/
+#define POOL_MAX_CHUNK 65536
+
+
+/**
+  Initializes the pool_t data structure.
+
+  @param p a pointer to an instance of the pool_t data structure
+  @param size the size of every slot handed out by p
+  @param first_chunk the number of slots in the first chunk; every later
+  chunk is twice as large as the one before it, up to POOL_MAX_CHUNK
+ */
+void pool_init(pool_t *p, size_t size, int first_chunk)
+{
+	//Every slot must be able to hold the free list link, suitably aligned.
+	if(size < sizeof(void *))
+		size = sizeof(void *);
+	p->slot_size = (size + sizeof(long long) - 1) / sizeof(long long) * sizeof(long long);
+
+	p->chunks = NULL;
+	p->free_list = NULL;
+	p->next_chunk = first_chunk > 0 ? first_chunk : 1;
+	p->carved = p->chunk_slots = 0;
+}
+
+
+/**
+  Hands out one slot, allocating a new chunk only when every slot of the
+  existing ones is in use.
+
+  @param p a pointer to an instance of the pool_t data structure
+  @return a pointer to an uninitialized slot
+  @return NULL if a new chunk was needed and could not be allocated
+ */
+void *pool_alloc(pool_t *p)
+{
+	void *slot;
+
+	if(p->free_list) {
+		slot = p->free_list;
+		p->free_list = *(void **) slot;
+		return slot;
+	}
+
+	if(p->carved == p->chunk_slots) {
+		pool_chunk_t *chunk = (pool_chunk_t *) malloc(sizeof(pool_chunk_t) + p->slot_size * p->next_chunk);
+		if(!chunk)
+			return NULL;
+
+		chunk->next = p->chunks;
+		p->chunks = chunk;
+		p->chunk_slots = p->next_chunk;
+		p->carved = 0;
+
+		if(p->next_chunk < POOL_MAX_CHUNK)
+			p->next_chunk *= 2;
+	}
+
+	return (char *) (p->chunks + 1) + p->slot_size * p->carved++;
+}
+
+
+/**
+  Puts a slot back on the free list.
+
+  @param p a pointer to an instance of the pool_t data structure
+  @param ptr a slot handed out by pool_alloc() on p
+ */
+void pool_free(pool_t *p, void *ptr)
+{
+	*(void **) ptr = p->free_list;
+	p->free_list = ptr;
+}
+
+
+/**
+  Frees every chunk of the pool at once, including slots still in use.
+
+  @param p a pointer to an instance of the pool_t data structure
+ */
+void pool_destroy(pool_t *p)
+{
+	pool_chunk_t *curr = p->chunks;
+	pool_chunk_t *next;
+
+	while(curr) {
+		next = curr->next;
+		free(curr);
+		curr = next;
+	}
+
+	p->chunks = NULL;
+	p->free_list = NULL;
+	p->carved = p->chunk_slots = 0;
+}
@@ -0,0 +1,40 @@
+/** @file libpool.h
+ */
+
+#ifndef LIBPOOL_H_
+#define LIBPOOL_H_
+
+#include <stddef.h>
+
+/**
+ * A block of memory carved into equally sized slots.
+ * The slots follow this header directly.
+ */
+typedef struct _pool_chunk_t {
+	struct _pool_chunk_t *next;
+	long long align; //keeps the first slot aligned for any member type
+} pool_chunk_t;
+
+/**
+  Pool Data Structure
+
+  Hands out fixed-size slots from chunks that grow geometrically. Freed
+  slots go on a free list and are handed out again before any new chunk
+  is allocated; nothing is returned to the system until pool_destroy().
+*/
+typedef struct _pool_t
+{
+	pool_chunk_t *chunks;
+	void *free_list;
+	size_t slot_size;
+	int next_chunk; //slots in the next chunk to be allocated
+	int carved; //slots of the newest chunk handed out so far
+	int chunk_slots; //slots in the newest chunk
+} pool_t;
+
+void   pool_init   (pool_t *p, size_t size, int first_chunk);
+void * pool_alloc  (pool_t *p);
+void   pool_free   (pool_t *p, void *ptr);
+void   pool_destroy(pool_t *p);
+
+#endif /* LIBPOOL_H_ */
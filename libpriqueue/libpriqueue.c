@@ -7,9 +7,47 @@
 #include "libpriqueue.h"
 
 
+/*
+ * Comparisons.
+ *
+ * A queue either calls its comparer on the data, or, once priqueue_set_key()
+ * has been called, compares the integer key stored inline in each entry.
+ * Every loop that compares is generated once per flavour below, so the
+ * choice is made once per operation and a keyed queue never makes an
+ * indirect call or reads the data it holds.
+ */
+#define CMP_DATA(q, a, b) ((q)->comparitor((a)->data, (b)->data))
+#define CMP_KEY(q, a, b)  ((a)->key != (b)->key ? ((a)->key > (b)->key) - ((a)->key < (b)->key) \
+                                                : ((a)->minor > (b)->minor) - ((a)->minor < (b)->minor))
+
+//The flavour of a generated function that suits q.
+#define SPECIALIZED(q, fn) ((q)->key_of ? fn##_key : fn##_data)
+
+
+//Fields common to every engine.
+static void queue_setup(priqueue_t *q, int(*comparer)(const void *, const void *), priqueue_kind_t kind)
+{
+	q->kind = kind;
+	q->root = q->tail = q->cursor = NULL;
+	q->cursor_index = 0;
+	q->heap = NULL;
+	q->capacity = 0;
+	q->sorted = 1;
+	q->buckets = NULL;
+	q->occupied = NULL;
+	q->num_buckets = 0;
+	q->bucket_of = NULL;
+	q->seq = 0;
+	q->size = 0;
+	q->comparitor = comparer;
+	q->key_of = NULL;
+	q->minor_of = NULL;
+	pool_init(&q->entries, sizeof(entry_t), 16);
+}
+
 /**
   Initializes the priqueue_t data structure.
-  
+
   Assumtions
     - You may assume this function will only be called once per instance of priqueue_t
     - You may assume this function will be the first function called using an instance of priqueue_t.
@@ -19,116 +57,1061 @@
  */
 void priqueue_init(priqueue_t *q, int(*comparer)(const void *, const void *))
 {
-	q->head = NULL;
-	q->size = 0;
-	q->comparitor = comparer;
+	priqueue_init_kind(q, comparer, PRIQUEUE_TREE);
 }
 
 
 /**
-  Inserts the specified element into this priority queue.
+  Initializes the priqueue_t data structure on top of a chosen storage engine.
 
+  The same assumptions as priqueue_init() apply.
   @param q a pointer to an instance of the priqueue_t data structure
-  @param ptr a pointer to the data to be inserted into the priority queue
-  @return The zero-based index where ptr is stored in the priority queue, where 0 indicates that ptr was stored at the front of the priority queue.
+  @param comparer a function pointer that compares two elements.
+  See also @ref comparer-page
+  @param kind the storage engine backing q
  */
-int priqueue_offer(priqueue_t *q, void *ptr)
+void priqueue_init_kind(priqueue_t *q, int(*comparer)(const void *, const void *), priqueue_kind_t kind)
 {
-	//The latest entry, named ironically after the oldest man in the Bible.
-	entry_t *methuselah = (entry_t *) malloc(sizeof(entry_t));
-	methuselah->data = ptr;
+	if(kind == PRIQUEUE_BUCKET)
+		priqueue_init_bucket(q, comparer, NULL, 1);
+	else
+		queue_setup(q, comparer, kind);
+}
+
+
+/**
+  Initializes the priqueue_t data structure as a PRIQUEUE_BUCKET queue.
+
+  bucket_of maps an element to a small integer, and must never put an
+  element in a higher bucket than one that the comparer orders after it.
+  Values below 0 or past the last bucket are clamped into the first or
+  last bucket, where the comparer still orders them correctly, so the
+  range only matters for speed. The same assumptions as priqueue_init()
+  apply.
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param comparer a function pointer that compares two elements.
+  See also @ref comparer-page
+  @param bucket_of a function pointer that maps an element to its bucket,
+  or NULL to put everything in a single bucket
+  @param buckets the number of buckets
+ */
+void priqueue_init_bucket(priqueue_t *q, int(*comparer)(const void *, const void *), int(*bucket_of)(const void *), int buckets)
+{
+	queue_setup(q, comparer, PRIQUEUE_BUCKET);
+
+	q->num_buckets = buckets > 0 ? buckets : 1;
+	q->bucket_of = bucket_of;
+	q->buckets = (priqueue_bucket_t *) calloc(q->num_buckets, sizeof(priqueue_bucket_t));
+	q->occupied = (unsigned long long *) calloc((q->num_buckets + 63) / 64, sizeof(unsigned long long));
+}
+
+
+/**
+  Makes q order its elements by an integer key instead of its comparer.
+
+  key_of is called once when an element is offered and again by
+  priqueue_update_key(); the key is stored next to the element, and
+  every comparison after that is a plain integer comparison. Smaller keys
+  leave first, and equal keys leave in the order they were offered. This
+  must be called after q is initialized and before anything is offered.
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param key_of a function pointer that maps an element to its key
+ */
+void priqueue_set_key(priqueue_t *q, long long(*key_of)(const void *))
+{
+	priqueue_set_keys(q, key_of, NULL);
+}
+
+
+/**
+  Makes q order its elements by an integer key, and elements with equal
+  keys by a second integer key, instead of its comparer.
+
+  This is priqueue_set_key() for orders that do not fit in one long long,
+  such as one 64-bit field and then another.
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param key_of a function pointer that maps an element to its key
+  @param minor_of a function pointer that maps an element to the key that
+  breaks ties; if NULL, equal keys leave in the order they were offered
+ */
+void priqueue_set_keys(priqueue_t *q, long long(*key_of)(const void *), long long(*minor_of)(const void *))
+{
+	q->key_of = key_of;
+	q->minor_of = minor_of;
+}
+
+
+//Stores the keys of a keyed queue inline in e.
+static void entry_key(priqueue_t *q, entry_t *e)
+{
+	e->key = (q->key_of)(e->data);
+	e->minor = q->minor_of ? (q->minor_of)(e->data) : 0;
+}
+
+
+/*
+ * Tree engine.
+ *
+ * Entries sit in a treap: a binary search tree in queue order that is
+ * also a min-heap on each entry's weight. Weights are a hash of seq, so
+ * the shape is balanced in expectation yet reproducible from run to run.
+ * Every node knows the size of its subtree, which turns rank lookups,
+ * rank removals and the rank returned by priqueue_offer() into walks
+ * down (or up) a single path.
+ */
+
+static int tree_size(entry_t *e)
+{
+	return e ? e->size : 0;
+}
+
+static void tree_resize(entry_t *e)
+{
+	e->size = 1 + tree_size(e->left) + tree_size(e->right);
+}
+
+static unsigned int tree_weight(unsigned long seq)
+{
+	unsigned int x = (unsigned int) (seq ^ ((unsigned long long) seq >> 32)) * 2654435761u;
+
+	x ^= x >> 16;
+	x *= 0x45d9f3bu;
+	return x ^ (x >> 16);
+}
+
+//Points whatever pointed at old (its parent or the root) at e instead.
+static void tree_replace(priqueue_t *q, entry_t *old, entry_t *e)
+{
+	if(!old->parent)
+		q->root = e;
+	else if(old->parent->left == old)
+		old->parent->left = e;
+	else
+		old->parent->right = e;
+
+	if(e)
+		e->parent = old->parent;
+}
+
+//Rotates e above its parent, keeping the in-order sequence intact.
+static void tree_rotate_up(priqueue_t *q, entry_t *e)
+{
+	entry_t *p = e->parent;
+
+	tree_replace(q, p, e);
+
+	if(p->left == e) {
+		p->left = e->right;
+		if(e->right)
+			e->right->parent = p;
+		e->right = p;
+	}
+	else {
+		p->right = e->left;
+		if(e->left)
+			e->left->parent = p;
+		e->left = p;
+	}
+	p->parent = e;
+
+	tree_resize(p);
+	tree_resize(e);
+}
+
+/*
+ * Finds the leaf position for e, growing every subtree on the way and
+ * counting the entries before it. Equal elements go to the right, so
+ * they leave in the order offered.
+ */
+#define TREE_DESCEND(flavour, CMP) \
+static entry_t *tree_descend_##flavour(priqueue_t *q, entry_t *e, int *rank, int *right) \
+{ \
+	entry_t *curr = q->root; \
+	entry_t *parent = NULL; \
+\
+	while(curr) { \
+		parent = curr; \
+		curr->size++; \
+		if((*right = CMP(q, curr, e) <= 0)) { \
+			*rank += tree_size(curr->left) + 1; \
+			curr = curr->right; \
+		} \
+		else \
+			curr = curr->left; \
+	} \
+\
+	return parent; \
+}
+
+TREE_DESCEND(data, CMP_DATA)
+TREE_DESCEND(key, CMP_KEY)
+
+static int tree_offer(priqueue_t *q, entry_t *e)
+{
+	entry_t *parent;
+	int rank = 0, right = 0;
+
+	e->left = e->right = NULL;
+	e->size = 1;
+	e->weight = tree_weight(e->seq);
+
+	parent = SPECIALIZED(q, tree_descend)(q, e, &rank, &right);
+
+	e->parent = parent;
+	if(!parent)
+		q->root = e;
+	else if(right)
+		parent->right = e;
+	else
+		parent->left = e;
+
+	while(e->parent && e->parent->weight > e->weight)
+		tree_rotate_up(q, e);
 
 	q->size++;
+	return rank;
+}
+
+static entry_t *tree_first(priqueue_t *q)
+{
+	entry_t *curr = q->root;
 
-	//If the queue is empty;
-	if(!q->head) {
-		q->head = methuselah;
-		methuselah->next = NULL;
-		return methuselah->index = 0;
+	while(curr && curr->left)
+		curr = curr->left;
+
+	return curr;
+}
+
+static entry_t *tree_next(entry_t *e)
+{
+	if(e->right) {
+		e = e->right;
+		while(e->left)
+			e = e->left;
+		return e;
 	}
 
-	entry_t *curr = q->head;
-	entry_t *prev = NULL;
-	
-	int hathchanged = 0;
+	while(e->parent && e->parent->right == e)
+		e = e->parent;
+
+	return e->parent;
+}
+
+static entry_t *tree_at(priqueue_t *q, int index)
+{
+	entry_t *curr = q->root;
 
 	while(curr) {
-		if(!hathchanged && (q->comparitor)(curr->data, methuselah->data) > 0) {
-			//If curr == q->head
-			if(!prev) {
-				q->head = methuselah;
-				methuselah->index = 0;	
-			}
-			else {
-				prev->next = methuselah;
-				methuselah->index = prev->index + 1;
-			}
-			methuselah->next = curr;
-			hathchanged = 1;
+		int left = tree_size(curr->left);
+
+		if(index == left)
+			return curr;
+
+		if(index < left)
+			curr = curr->left;
+		else {
+			index -= left + 1;
+			curr = curr->right;
+		}
+	}
+
+	return NULL;
+}
+
+//Detaches e from the tree; the caller owns it afterwards.
+static void tree_unlink(priqueue_t *q, entry_t *e)
+{
+	entry_t *child;
+
+	while(e->left && e->right)
+		tree_rotate_up(q, e->left->weight < e->right->weight ? e->left : e->right);
+
+	child = e->left ? e->left : e->right;
+	tree_replace(q, e, child);
+
+	for(child = e->parent; child; child = child->parent)
+		child->size--;
+
+	q->size--;
+}
+
+
+/*
+ * FIFO engine.
+ *
+ * Entries sit in a doubly linked list, left pointing towards the head
+ * and right towards the tail; the comparer is never called. q->cursor
+ * remembers the last entry priqueue_at() reached, so walking the queue
+ * by increasing index costs one step per call.
+ */
+
+static int fifo_offer(priqueue_t *q, entry_t *e)
+{
+	e->left = q->tail;
+	e->right = NULL;
+
+	if(q->tail)
+		q->tail->right = e;
+	else
+		q->root = e;
+	q->tail = e;
+
+	return q->size++;
+}
+
+static entry_t *fifo_at(priqueue_t *q, int index)
+{
+	entry_t *curr = q->root;
+	int at = 0;
+
+	if(q->cursor && abs(q->cursor_index - index) < index) {
+		curr = q->cursor;
+		at = q->cursor_index;
+	}
+	if(q->size - 1 - index < abs(at - index)) {
+		curr = q->tail;
+		at = q->size - 1;
+	}
+
+	for(; at < index; at++)
+		curr = curr->right;
+	for(; at > index; at--)
+		curr = curr->left;
+
+	q->cursor = curr;
+	q->cursor_index = index;
+	return curr;
+}
+
+static void fifo_unlink(priqueue_t *q, entry_t *e)
+{
+	//Taking the head moves everyone up a spot; anything else loses the cursor.
+	if(e == q->root && e != q->cursor)
+		q->cursor_index--;
+	else
+		q->cursor = NULL;
+
+	if(e->left)
+		e->left->right = e->right;
+	else
+		q->root = e->right;
+
+	if(e->right)
+		e->right->left = e->left;
+	else
+		q->tail = e->left;
+
+	q->size--;
+}
+
+
+/*
+ * Bucket engine.
+ *
+ * Entries are spread over q->buckets by q->bucket_of, and each bucket is
+ * a doubly linked list kept sorted by the comparer. Offers walk in from
+ * both ends of their bucket at once, so elements that arrive in order,
+ * like arrival times, or that share a bucket with older ones, like equal
+ * priorities, land in constant time, and one that belongs near the head,
+ * like a preempted job, does too. q->occupied has a bit per non-empty
+ * bucket, which finds the lowest one a word at a time. The entry's slot
+ * is the bucket it sits in.
+ */
+
+static int bucket_index(priqueue_t *q, void *data)
+{
+	int b = q->bucket_of ? (q->bucket_of)(data) : 0;
+
+	if(b < 0)
+		return 0;
+	if(b >= q->num_buckets)
+		return q->num_buckets - 1;
+	return b;
+}
+
+//The first non-empty bucket at or after b, or -1.
+static int bucket_scan(priqueue_t *q, int b)
+{
+	int word = b / 64;
+	unsigned long long bits;
+
+	if(b >= q->num_buckets)
+		return -1;
+
+	bits = q->occupied[word] & (~0ULL << (b % 64));
+	while(!bits) {
+		if(++word * 64 >= q->num_buckets)
+			return -1;
+		bits = q->occupied[word];
+	}
+
+	return word * 64 + __builtin_ctzll(bits);
+}
+
+/*
+ * Finds the entry of bucket e belongs right after, or NULL for its head,
+ * stepping in from the tail and the head in turn so the walk is only as
+ * long as e's distance from the nearer end. Equal elements stay behind
+ * the ones already there. *rank is set to e's rank within the bucket.
+ */
+#define BUCKET_WALK(flavour, CMP) \
+static entry_t *bucket_walk_##flavour(priqueue_t *q, priqueue_bucket_t *bucket, entry_t *e, int *rank) \
+{ \
+	entry_t *tail = bucket->tail, *head = bucket->head; \
+	int from_head = 0; \
+\
+	while(tail && CMP(q, tail, e) > 0) { \
+		if(CMP(q, head, e) > 0) { \
+			*rank = from_head; \
+			return head->left; \
+		} \
+		tail = tail->left; \
+		head = head->right; \
+		from_head++; \
+	} \
+\
+	*rank = bucket->count - from_head; \
+	return tail; \
+}
+
+BUCKET_WALK(data, CMP_DATA)
+BUCKET_WALK(key, CMP_KEY)
+
+static int bucket_offer(priqueue_t *q, entry_t *e)
+{
+	int b = bucket_index(q, e->data);
+	priqueue_bucket_t *bucket = &q->buckets[b];
+	int rank;
+	entry_t *curr = SPECIALIZED(q, bucket_walk)(q, bucket, e, &rank);
+
+	e->slot = b;
+	e->left = curr;
+	e->right = curr ? curr->right : bucket->head;
+	if(e->left)
+		e->left->right = e;
+	else
+		bucket->head = e;
+	if(e->right)
+		e->right->left = e;
+	else
+		bucket->tail = e;
+
+	bucket->count++;
+	q->occupied[b / 64] |= 1ULL << (b % 64);
+	q->cursor = NULL;
+	q->size++;
+
+	for(b = bucket_scan(q, 0); b < e->slot; b = bucket_scan(q, b + 1))
+		rank += q->buckets[b].count;
+
+	return rank;
+}
+
+static entry_t *bucket_first(priqueue_t *q)
+{
+	return q->buckets[bucket_scan(q, 0)].head;
+}
+
+static entry_t *bucket_next(priqueue_t *q, entry_t *e)
+{
+	int b;
+
+	if(e->right)
+		return e->right;
+
+	b = bucket_scan(q, e->slot + 1);
+	return b < 0 ? NULL : q->buckets[b].head;
+}
+
+static entry_t *bucket_at(priqueue_t *q, int index)
+{
+	entry_t *curr;
+	int b;
+
+	//Walking the queue in order costs one step per call.
+	if(q->cursor && q->cursor_index == index - 1)
+		curr = bucket_next(q, q->cursor);
+	else {
+		int at = index;
+
+		for(b = bucket_scan(q, 0); at >= q->buckets[b].count; b = bucket_scan(q, b + 1))
+			at -= q->buckets[b].count;
+
+		//Walk in from whichever end of the bucket is closer.
+		if(at < q->buckets[b].count / 2)
+			for(curr = q->buckets[b].head; at > 0; at--)
+				curr = curr->right;
+		else
+			for(curr = q->buckets[b].tail, at = q->buckets[b].count - 1 - at; at > 0; at--)
+				curr = curr->left;
+	}
+
+	q->cursor = curr;
+	q->cursor_index = index;
+	return curr;
+}
+
+static void bucket_unlink(priqueue_t *q, entry_t *e)
+{
+	priqueue_bucket_t *bucket = &q->buckets[e->slot];
+
+	if(e->left)
+		e->left->right = e->right;
+	else
+		bucket->head = e->right;
+
+	if(e->right)
+		e->right->left = e->left;
+	else
+		bucket->tail = e->left;
+
+	if(!--bucket->count)
+		q->occupied[e->slot / 64] &= ~(1ULL << (e->slot % 64));
+
+	q->cursor = NULL;
+	q->size--;
+}
+
+
+/*
+ * Heap engine.
+ *
+ * Entries sit in q->heap as a binary min-heap; ties on the comparer are
+ * broken by seq so equal elements leave first-in first-out, exactly like
+ * the tree. A fully sorted array is also a valid heap, so priqueue_at()
+ * sorts the slots once and q->sorted remembers that until an operation
+ * disturbs the order again.
+ */
+
+static void heap_place(priqueue_t *q, entry_t *e, int slot)
+{
+	q->heap[slot] = e;
+	e->slot = slot;
+}
+
+/*
+ * heap_less tells whether a leaves before b. The sifts move one entry
+ * up or down to where it belongs; sift down only treats the first n
+ * slots as part of the heap.
+ */
+#define HEAP_SIFT(flavour, CMP) \
+static int heap_less_##flavour(priqueue_t *q, entry_t *a, entry_t *b) \
+{ \
+	int cmp = CMP(q, a, b); \
+\
+	return cmp < 0 || (cmp == 0 && a->seq < b->seq); \
+} \
+\
+static void heap_sift_up_##flavour(priqueue_t *q, int slot) \
+{ \
+	entry_t *e = q->heap[slot]; \
+\
+	while(slot > 0 && heap_less_##flavour(q, e, q->heap[(slot - 1) / 2])) { \
+		heap_place(q, q->heap[(slot - 1) / 2], slot); \
+		slot = (slot - 1) / 2; \
+	} \
+	heap_place(q, e, slot); \
+} \
+\
+static void heap_sift_down_##flavour(priqueue_t *q, int slot, int n) \
+{ \
+	entry_t *e = q->heap[slot]; \
+	int child; \
+\
+	while((child = 2 * slot + 1) < n) { \
+		if(child + 1 < n && heap_less_##flavour(q, q->heap[child + 1], q->heap[child])) \
+			child++; \
+		if(!heap_less_##flavour(q, q->heap[child], e)) \
+			break; \
+		heap_place(q, q->heap[child], slot); \
+		slot = child; \
+	} \
+	heap_place(q, e, slot); \
+}
+
+HEAP_SIFT(data, CMP_DATA)
+HEAP_SIFT(key, CMP_KEY)
+
+static int heap_less(priqueue_t *q, entry_t *a, entry_t *b)
+{
+	return SPECIALIZED(q, heap_less)(q, a, b);
+}
+
+static void heap_sift_up(priqueue_t *q, int slot)
+{
+	SPECIALIZED(q, heap_sift_up)(q, slot);
+}
+
+static void heap_sift_down(priqueue_t *q, int slot, int n)
+{
+	SPECIALIZED(q, heap_sift_down)(q, slot, n);
+}
+
+static void heap_heapify(priqueue_t *q)
+{
+	int slot;
+	for(slot = q->size / 2 - 1; slot >= 0; slot--)
+		heap_sift_down(q, slot, q->size);
+}
+
+//Heapsort in place: popping into the tail leaves the slots in reverse order.
+static void heap_sort(priqueue_t *q)
+{
+	int n, lo, hi;
+	entry_t *temp;
+
+	if(q->sorted)
+		return;
+
+	for(n = q->size - 1; n > 0; n--) {
+		temp = q->heap[0];
+		heap_place(q, q->heap[n], 0);
+		heap_place(q, temp, n);
+		heap_sift_down(q, 0, n);
+	}
+
+	for(lo = 0, hi = q->size - 1; lo < hi; lo++, hi--) {
+		temp = q->heap[lo];
+		heap_place(q, q->heap[hi], lo);
+		heap_place(q, temp, hi);
+	}
+
+	q->sorted = 1;
+}
+
+static int heap_offer(priqueue_t *q, entry_t *e)
+{
+	if(q->size == q->capacity) {
+		q->capacity = q->capacity ? q->capacity * 2 : 16;
+		q->heap = (entry_t **) realloc(q->heap, sizeof(entry_t *) * q->capacity);
+	}
+
+	int slot = q->size++;
+	if(q->sorted && slot > 0 && heap_less(q, e, q->heap[slot - 1]))
+		q->sorted = 0;
+
+	heap_place(q, e, slot);
+	heap_sift_up(q, slot);
+
+	return e->slot;
+}
+
+//Restores the heap order around a slot whose occupant may be out of place.
+static void heap_fix(priqueue_t *q, int slot)
+{
+	entry_t *e = q->heap[slot];
+
+	heap_sift_up(q, slot);
+	if(e->slot == slot)
+		heap_sift_down(q, slot, q->size);
+}
+
+//Detaches the entry in a slot; the caller owns it afterwards.
+static void heap_unlink(priqueue_t *q, entry_t *e)
+{
+	int slot = e->slot;
+
+	q->size--;
+	if(slot < q->size) {
+		heap_place(q, q->heap[q->size], slot);
+		heap_fix(q, slot);
+		q->sorted = 0;
+	}
+	if(q->size <= 1)
+		q->sorted = 1;
+}
+
+static void *heap_poll(priqueue_t *q)
+{
+	entry_t *e = q->heap[0];
+	void *data = e->data;
+
+	heap_unlink(q, e);
+
+	pool_free(&q->entries, e);
+	return data;
+}
+
+static void *heap_remove_at(priqueue_t *q, int index)
+{
+	heap_sort(q);
+
+	entry_t *e = q->heap[index];
+	void *data = e->data;
+	int slot;
+
+	q->size--;
+	for(slot = index; slot < q->size; slot++)
+		heap_place(q, q->heap[slot + 1], slot);
+
+	pool_free(&q->entries, e);
+	return data;
+}
+
+static int heap_remove(priqueue_t *q, void *ptr)
+{
+	int slot, kept = 0;
+
+	for(slot = 0; slot < q->size; slot++) {
+		if(q->heap[slot]->data == ptr)
+			pool_free(&q->entries, q->heap[slot]);
+		else
+			heap_place(q, q->heap[slot], kept++);
+	}
+
+	int removed = q->size - kept;
+	q->size = kept;
+
+	//Dropping slots keeps a sorted array sorted, but may break the heap order.
+	if(removed && !q->sorted)
+		heap_heapify(q);
+
+	return removed;
+}
+
+
+/*
+ * Batches.
+ *
+ * A batch that is large next to the queue is cheaper to merge in whole
+ * than to offer one entry at a time: the heap appends it and rebuilds
+ * in linear time, and the tree sorts it, merges it with its own entries
+ * and links the result back into a treap in linear time.
+ */
+
+//Whether n new entries are worth a rebuild of a queue holding size.
+#define BATCH_REBUILDS(n, size) ((n) >= (size) / 8)
+
+static void heap_offer_batch(priqueue_t *q, entry_t **batch, int n)
+{
+	int i, slot, rebuild = BATCH_REBUILDS(n, q->size);
+
+	if(q->size + n > q->capacity) {
+		q->capacity = q->capacity * 2 > q->size + n ? q->capacity * 2 : q->size + n;
+		q->heap = (entry_t **) realloc(q->heap, sizeof(entry_t *) * q->capacity);
+	}
+
+	for(i = 0; i < n; i++) {
+		slot = q->size++;
+		if(q->sorted && slot > 0 && heap_less(q, batch[i], q->heap[slot - 1]))
+			q->sorted = 0;
+
+		heap_place(q, batch[i], slot);
+		if(!rebuild)
+			heap_sift_up(q, slot);
+	}
+
+	if(rebuild && !q->sorted)
+		heap_heapify(q);
+}
+
+//Stable merge sort of entries into queue order, using scratch for space.
+static void entries_sort(priqueue_t *q, entry_t **v, entry_t **scratch, int n)
+{
+	int mid = n / 2, i = 0, j = mid, k = 0;
+
+	if(n < 2)
+		return;
+
+	entries_sort(q, v, scratch, mid);
+	entries_sort(q, v + mid, scratch, n - mid);
+
+	while(i < mid && j < n)
+		scratch[k++] = heap_less(q, v[j], v[i]) ? v[j++] : v[i++];
+	while(i < mid)
+		scratch[k++] = v[i++];
+	while(j < n)
+		scratch[k++] = v[j++];
+
+	for(k = 0; k < n; k++)
+		v[k] = scratch[k];
+}
+
+//Hangs e under parent and fixes up parent links and sizes below it.
+static int tree_adopt(entry_t *e, entry_t *parent)
+{
+	if(!e)
+		return 0;
+
+	e->parent = parent;
+	e->size = 1 + tree_adopt(e->left, e) + tree_adopt(e->right, e);
+	return e->size;
+}
+
+/*
+ * Links entries already in queue order into a treap in linear time: each
+ * new entry becomes the right child of the last one lighter than it,
+ * adopting the heavier ones it displaces as its left subtree.
+ */
+static void tree_build(priqueue_t *q, entry_t **v, entry_t **spine, int n)
+{
+	int i, top = 0;
+	entry_t *last;
+
+	for(i = 0; i < n; i++) {
+		v[i]->weight = tree_weight(v[i]->seq);
+		v[i]->right = last = NULL;
+
+		while(top > 0 && spine[top - 1]->weight > v[i]->weight)
+			last = spine[--top];
+
+		v[i]->left = last;
+		if(top > 0)
+			spine[top - 1]->right = v[i];
+		spine[top++] = v[i];
+	}
+
+	q->root = top ? spine[0] : NULL;
+	q->size = tree_adopt(q->root, NULL);
+}
+
+static void tree_offer_batch(priqueue_t *q, entry_t **batch, int n)
+{
+	int i, j, k, size = q->size;
+	entry_t *curr;
+
+	if(!BATCH_REBUILDS(n, size)) {
+		for(i = 0; i < n; i++)
+			tree_offer(q, batch[i]);
+		return;
+	}
+
+	entry_t **all = (entry_t **) malloc(sizeof(entry_t *) * (size + n) * 2);
+	entry_t **scratch = all + size + n;
+
+	entries_sort(q, batch, scratch, n);
+
+	//The batch was offered last, so it goes behind anything it ties with.
+	for(curr = tree_first(q), j = 0, k = 0; k < size + n; k++) {
+		if(j == n || (curr && !heap_less(q, batch[j], curr))) {
+			all[k] = curr;
+			curr = tree_next(curr);
 		}
-		if(hathchanged)
-			curr->index++;
+		else
+			all[k] = batch[j++];
+	}
+
+	tree_build(q, all, scratch, size + n);
+	free(all);
+}
 
-		prev = curr;
-		curr = curr->next;
+
+/*
+ * Every engine offers, finds and unlinks entries in its own way; the
+ * public functions below only pick the right one.
+ */
+
+static entry_t *entry_new(priqueue_t *q, void *ptr)
+{
+	entry_t *e = (entry_t *) pool_alloc(&q->entries);
+
+	e->data = ptr;
+	e->seq = q->seq++;
+	if(q->key_of)
+		entry_key(q, e);
+
+	return e;
+}
+
+static int engine_offer(priqueue_t *q, entry_t *e)
+{
+	switch(q->kind) {
+		case PRIQUEUE_HEAP: return heap_offer(q, e);
+		case PRIQUEUE_FIFO: return fifo_offer(q, e);
+		case PRIQUEUE_BUCKET: return bucket_offer(q, e);
+		default: return tree_offer(q, e);
 	}
-	
-	if(!hathchanged) {
-		prev->next = methuselah;
-		methuselah->next = NULL;
-		methuselah->index = prev->index + 1;
+}
+
+static entry_t *engine_first(priqueue_t *q)
+{
+	switch(q->kind) {
+		case PRIQUEUE_HEAP: return q->heap[0];
+		case PRIQUEUE_FIFO: return q->root;
+		case PRIQUEUE_BUCKET: return bucket_first(q);
+		default: return tree_first(q);
 	}
+}
 
-	return methuselah->index;
+static entry_t *engine_next(priqueue_t *q, entry_t *e)
+{
+	switch(q->kind) {
+		case PRIQUEUE_FIFO: return e->right;
+		case PRIQUEUE_BUCKET: return bucket_next(q, e);
+		default: return tree_next(e);
+	}
+}
 
+static entry_t *engine_at(priqueue_t *q, int index)
+{
+	switch(q->kind) {
+		case PRIQUEUE_HEAP: heap_sort(q); return q->heap[index];
+		case PRIQUEUE_FIFO: return fifo_at(q, index);
+		case PRIQUEUE_BUCKET: return bucket_at(q, index);
+		default: return tree_at(q, index);
+	}
+}
+
+static void engine_unlink(priqueue_t *q, entry_t *e)
+{
+	switch(q->kind) {
+		case PRIQUEUE_HEAP: heap_unlink(q, e); break;
+		case PRIQUEUE_FIFO: fifo_unlink(q, e); break;
+		case PRIQUEUE_BUCKET: bucket_unlink(q, e); break;
+		default: tree_unlink(q, e); break;
+	}
+}
+
+
+/**
+  Inserts the specified element into this priority queue.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param ptr a pointer to the data to be inserted into the priority queue
+  @return The zero-based index where ptr is stored in the priority queue, where 0 indicates that ptr was stored at the front of the priority queue.
+  A PRIQUEUE_HEAP queue does not know its ranks without sorting, so it returns 0 if ptr is at the front and -1 otherwise.
+ */
+int priqueue_offer(priqueue_t *q, void *ptr)
+{
+	//The latest entry, named ironically after the oldest man in the Bible.
+	entry_t *methuselah = entry_new(q, ptr);
+	int index = engine_offer(q, methuselah);
+
+	if(q->kind == PRIQUEUE_HEAP && index != 0)
+		return -1;
+	return index;
+}
+
+
+/**
+  Inserts the specified element into this priority queue and returns a
+  handle to it instead of its index.
+
+  The handle stays valid, wherever the element moves, until the element
+  leaves the queue by any means.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param ptr a pointer to the data to be inserted into the priority queue
+  @return a handle to the inserted element
+ */
+priqueue_handle_t priqueue_offer_handle(priqueue_t *q, void *ptr)
+{
+	entry_t *e = entry_new(q, ptr);
+
+	engine_offer(q, e);
+	return e;
+}
+
+
+/**
+  Inserts n elements into this priority queue at once.
+
+  The result is the same as offering ptrs[0] through ptrs[n - 1] in turn,
+  but a batch that is large next to the queue is merged in whole, in time
+  linear in the size of the queue plus the cost of sorting the batch.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param ptrs the elements to be inserted
+  @param n the number of elements in ptrs
+ */
+void priqueue_offer_batch(priqueue_t *q, void **ptrs, int n)
+{
+	int i;
+
+	if(n <= 0)
+		return;
+
+	entry_t **batch = (entry_t **) malloc(sizeof(entry_t *) * n);
+	for(i = 0; i < n; i++)
+		batch[i] = entry_new(q, ptrs[i]);
+
+	switch(q->kind) {
+		case PRIQUEUE_HEAP: heap_offer_batch(q, batch, n); break;
+		case PRIQUEUE_TREE: tree_offer_batch(q, batch, n); break;
+		default:
+			for(i = 0; i < n; i++)
+				engine_offer(q, batch[i]);
+			break;
+	}
+
+	free(batch);
+}
+
+
+/**
+  Fills an empty priority queue with n elements.
+
+  The result is the same as offering ptrs[0] through ptrs[n - 1] in turn.
+  A heap is built in linear time; a tree sorts the elements and links
+  them in linear time.
+
+  @param q a pointer to an instance of the priqueue_t data structure, which
+  should be empty; otherwise this behaves like priqueue_offer_batch()
+  @param ptrs the elements to be inserted
+  @param n the number of elements in ptrs
+ */
+void priqueue_build(priqueue_t *q, void **ptrs, int n)
+{
+	//An empty queue always takes the whole-batch path.
+	priqueue_offer_batch(q, ptrs, n);
+}
+
+
+/**
+  Retrieves and removes up to k elements from the head of this queue.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param ptrs where the elements are stored, in the order they left
+  @param k the most elements to remove
+  @return the number of elements removed, which is less than k only if the queue ran empty
+ */
+int priqueue_poll_batch(priqueue_t *q, void **ptrs, int k)
+{
+	int polled = 0;
+
+	while(polled < k && q->size)
+		ptrs[polled++] = priqueue_poll(q);
+
+	return polled;
 }
 
 
 /**
   Retrieves, but does not remove, the head of this queue, returning NULL if
   this queue is empty.
- 
+
   @param q a pointer to an instance of the priqueue_t data structure
   @return pointer to element at the head of the queue
   @return NULL if the queue is empty
  */
 void *priqueue_peek(priqueue_t *q)
 {
-	if(!q->head)
+	if(!q->size)
 		return NULL;
-	
-	return q->head->data;
+
+	return engine_first(q)->data;
 }
 
 
 /**
   Retrieves and removes the head of this queue, or NULL if this queue
   is empty.
- 
+
   @param q a pointer to an instance of the priqueue_t data structure
   @return the head of this queue
   @return NULL if this queue is empty
  */
 void *priqueue_poll(priqueue_t *q)
 {
-	if(!q->head)
+	if(!q->size)
 		return NULL;
-	
-	void *data = q->head->data;
 
-	entry_t *curr  = q->head->next;
+	entry_t *head = engine_first(q);
+	void *data = head->data;
 
-	while(curr) {
-		curr->index--;
-		curr = curr->next;
-	}
+	engine_unlink(q, head);
+	pool_free(&q->entries, head);
 
-	curr = q->head;
-	q->head = q->head->next ? q->head->next : NULL; //I don't know if this check was necessary.
-	
-	free(curr);
-	
-	q->size--;
 	return data;
 }
 
@@ -136,7 +1119,7 @@ void *priqueue_poll(priqueue_t *q)
 /**
   Returns the element at the specified position in this list, or NULL if
   the queue does not contain an index'th element.
- 
+
   @param q a pointer to an instance of the priqueue_t data structure
   @param index position of retrieved element
   @return the index'th element in the queue
@@ -144,61 +1127,40 @@ void *priqueue_poll(priqueue_t *q)
  */
 void *priqueue_at(priqueue_t *q, int index)
 {
-	entry_t *curr = q->head;
+	if(index < 0 || index >= q->size)
+		return NULL;
 
-	while(curr) {
-		if(curr->index == index)
-			return curr->data;
-	
-		curr = curr->next;
-	}
-	
-	return NULL;
+	return engine_at(q, index)->data;
 }
 
 
 /**
-  Removes all instances of ptr from the queue. 
-  
+  Removes all instances of ptr from the queue.
+
   This function should not use the comparer function, but check if the data contained in each element of the queue is equal (==) to ptr.
- 
+
   @param q a pointer to an instance of the priqueue_t data structure
   @param ptr address of element to be removed
   @return the number of entries removed
  */
 int priqueue_remove(priqueue_t *q, void *ptr)
-{	
-	entry_t *curr = q->head;
-	entry_t *prev = NULL;
-	int removed = 0;
+{
+	if(q->kind == PRIQUEUE_HEAP)
+		return heap_remove(q, ptr);
 
-	if(!q->head) return removed;
+	entry_t *curr = q->size ? engine_first(q) : NULL;
+	entry_t *next;
+	int removed = 0;
 
+	//Unlinking only rotates and splices, so the successor stays valid.
 	while(curr) {
+		next = engine_next(q, curr);
 		if(ptr == curr->data) {
+			engine_unlink(q, curr);
+			pool_free(&q->entries, curr);
 			removed++;
-			q->size--;
-			if(!prev) {
-				q->head = curr->next;
-				entry_t *temp = curr;
-				curr = curr->next;
-				free(temp);
-				continue;
-			}
-			prev->next = curr->next;
-			entry_t *temp = curr;
-			curr = prev;
-			free(temp);
 		}
-		prev = curr;
-		curr = curr->next;
-	}
-	//Fixing the indices
-	int index = 0;
-	curr = q->head;
-	while(curr) {
-		curr->index = index++;
-		curr = curr->next;
+		curr = next;
 	}
 
 	return removed;
@@ -208,7 +1170,7 @@ int priqueue_remove(priqueue_t *q, void *ptr)
 /**
   Removes the specified index from the queue, moving later elements up
   a spot in the queue to fill the gap.
- 
+
   @param q a pointer to an instance of the priqueue_t data structure
   @param index position of element to be removed
   @return the element removed from the queue
@@ -216,41 +1178,72 @@ int priqueue_remove(priqueue_t *q, void *ptr)
  */
 void *priqueue_remove_at(priqueue_t *q, int index)
 {
-	entry_t *curr = q->head;
-    entry_t *prev = NULL;
-    int found = 0;
-
-    while(curr && !found) {
-        if(curr->index == index) {
-            if(!prev)
-                q->head = curr->next;
-			else prev->next = curr->next;
-            
-			found = 1;
-        }
-
-        prev = curr;
-        curr = curr->next;
-    }
-
-    if(found) {
-        void *data = prev->data;
-        free(prev);
-        while(curr) {
-            curr->index--;
-            curr = curr->next;
-        }
-		
-		q->size--;
-        return data;
-    }
-    return NULL;
+	if(index < 0 || index >= q->size)
+		return NULL;
+
+	if(q->kind == PRIQUEUE_HEAP)
+		return heap_remove_at(q, index);
+
+	entry_t *e = engine_at(q, index);
+	void *data = e->data;
+
+	engine_unlink(q, e);
+	pool_free(&q->entries, e);
+
+	return data;
+}
+
+
+/**
+  Removes the element behind a handle from the queue.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param handle a handle returned by priqueue_offer_handle() for an element still in q
+  @return the element removed from the queue
+ */
+void *priqueue_remove_handle(priqueue_t *q, priqueue_handle_t handle)
+{
+	void *data = handle->data;
+
+	engine_unlink(q, handle);
+	pool_free(&q->entries, handle);
+
+	return data;
+}
+
+
+/**
+  Moves the element behind a handle to where its key now belongs.
+
+  Call this after changing whatever the comparer or key function looks at
+  in the element.
+  The element is placed as if it had been removed and offered again, so it
+  goes behind any elements it now compares equal to; in a PRIQUEUE_FIFO
+  that means the tail. The handle stays valid.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param handle a handle returned by priqueue_offer_handle() for an element still in q
+ */
+void priqueue_update_key(priqueue_t *q, priqueue_handle_t handle)
+{
+	handle->seq = q->seq++;
+	if(q->key_of)
+		entry_key(q, handle);
+
+	if(q->kind == PRIQUEUE_HEAP) {
+		heap_fix(q, handle->slot);
+		q->sorted = q->size <= 1;
+		return;
+	}
+
+	engine_unlink(q, handle);
+	engine_offer(q, handle);
 }
 
 
 /**
   Returns the number of elements in the queue.
- 
+
   @param q a pointer to an instance of the priqueue_t data structure
   @return the number of elements in the queue
  */
@@ -262,21 +1255,14 @@ int priqueue_size(priqueue_t *q)
 
 /**
   Destroys and frees all the memory associated with q.
-  
+
   @param q a pointer to an instance of the priqueue_t data structure
  */
 void priqueue_destroy(priqueue_t *q)
 {
-	entry_t *curr = q->head;
-	entry_t *prev = NULL;
-
-	while(curr) {
-		if(prev)
-			free(prev);
-
-		prev = curr;
-		curr = curr->next;
-	}
-
-	free(prev);
+	//Every entry lives in the pool, so there is no need to walk them.
+	pool_destroy(&q->entries);
+	free(q->heap);
+	free(q->buckets);
+	free(q->occupied);
 }
@@ -4,35 +4,99 @@
 #ifndef LIBPRIQUEUE_H_
 #define LIBPRIQUEUE_H_
 
+#include "../libpool/libpool.h"
 
 /**
- * A single entry in this priority queue,
- * which is implemented as a linked list.
+  Storage engines available behind the priqueue_t interface.
+
+  PRIQUEUE_TREE keeps the elements in a balanced search tree that knows
+  the size of every subtree, so offer, poll, priqueue_at() and
+  priqueue_remove_at() are all logarithmic. PRIQUEUE_HEAP keeps them in an
+  array-backed binary heap, so offer and poll are logarithmic and rank
+  access sorts the heap on demand; priqueue_offer() on a heap only says
+  whether the element went to the front (0) or not (-1). Either way, elements that compare equal
+  leave in the order they were offered. PRIQUEUE_FIFO ignores the comparer
+  and keeps the elements in the order they were offered, with constant-time
+  offer and poll. PRIQUEUE_BUCKET spreads the elements over a small range
+  of integer buckets, which makes offer and poll constant time when the
+  keys are small integers or arrive in order; see priqueue_init_bucket().
+*/
+typedef enum {PRIQUEUE_TREE = 0, PRIQUEUE_HEAP, PRIQUEUE_FIFO, PRIQUEUE_BUCKET} priqueue_kind_t;
+
+/**
+ * A single entry in this priority queue.
+ * In a tree it is a node; in a heap, slot is where it sits; in a FIFO,
+ * left and right are the neighbours towards the head and the tail; in a
+ * bucket queue they are the same within the bucket numbered slot.
  */
 typedef struct _priqueue_entry_t {
-    struct _priqueue_entry_t *next;
-    void *data;
-	int index;
+	struct _priqueue_entry_t *left, *right, *parent;
+	void *data;
+	long long key; //the inline sort key of a keyed queue
+	long long minor; //breaks ties between equal keys
+	int size; //number of entries in the subtree rooted here
+	int slot;
+	unsigned int weight; //keeps the tree balanced
+	unsigned long seq; //the order in which it was offered
 } entry_t;
 
+/**
+  An opaque reference to one element of a priqueue_t, valid until that
+  element leaves the queue.
+*/
+typedef entry_t *priqueue_handle_t;
+
+/**
+ * One bucket of a PRIQUEUE_BUCKET queue.
+ */
+typedef struct _priqueue_bucket_t {
+	entry_t *head, *tail;
+	int count;
+} priqueue_bucket_t;
+
 /**
   Priqueue Data Structure
 */
 typedef struct _priqueue_t
 {
-	entry_t *head;
+	priqueue_kind_t kind;
+	entry_t *root; //the root of a PRIQUEUE_TREE, or the head of a PRIQUEUE_FIFO
+	entry_t *tail;
+	entry_t *cursor; //the entry last reached by priqueue_at() in a PRIQUEUE_FIFO or PRIQUEUE_BUCKET
+	int cursor_index;
+	entry_t **heap; //slots of a PRIQUEUE_HEAP
+	int capacity;
+	int sorted; //1 = the heap slots are also in queue order
+	priqueue_bucket_t *buckets;
+	unsigned long long *occupied; //1 bit per non-empty bucket
+	int num_buckets;
+	int (*bucket_of)(const void *);
+	unsigned long seq;
 	int size;
 	int (*comparitor)(const void *, const void *);
+	long long (*key_of)(const void *); //set by priqueue_set_key(); replaces comparitor
+	long long (*minor_of)(const void *); //set by priqueue_set_keys(); NULL if ties go by offer order
+	pool_t entries; //where every entry_t of this queue is allocated
 } priqueue_t;
 
 void   priqueue_init     (priqueue_t *q, int(*comparer)(const void *, const void *));
+void   priqueue_init_kind(priqueue_t *q, int(*comparer)(const void *, const void *), priqueue_kind_t kind);
+void   priqueue_init_bucket(priqueue_t *q, int(*comparer)(const void *, const void *), int(*bucket_of)(const void *), int buckets);
+void   priqueue_set_key  (priqueue_t *q, long long(*key_of)(const void *));
+void   priqueue_set_keys (priqueue_t *q, long long(*key_of)(const void *), long long(*minor_of)(const void *));
 
 int    priqueue_offer    (priqueue_t *q, void *ptr);
+priqueue_handle_t priqueue_offer_handle(priqueue_t *q, void *ptr);
+void   priqueue_offer_batch(priqueue_t *q, void **ptrs, int n);
+void   priqueue_build    (priqueue_t *q, void **ptrs, int n);
+int    priqueue_poll_batch(priqueue_t *q, void **ptrs, int k);
 void * priqueue_peek     (priqueue_t *q);
 void * priqueue_poll     (priqueue_t *q);
 void * priqueue_at       (priqueue_t *q, int index);
 int    priqueue_remove   (priqueue_t *q, void *ptr);
 void * priqueue_remove_at(priqueue_t *q, int index);
+void * priqueue_remove_handle(priqueue_t *q, priqueue_handle_t handle);
+void   priqueue_update_key(priqueue_t *q, priqueue_handle_t handle);
 int    priqueue_size     (priqueue_t *q);
 
 void   priqueue_destroy  (priqueue_t *q);
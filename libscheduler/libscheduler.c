@@ -4,94 +4,461 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <math.h>
 
 #include "libscheduler.h"
+#include "scheduler_internal.h"
 #include "../libpriqueue/libpriqueue.h"
-
-/**
-  Stores information making up a job to be scheduled including any statistics.
-
-  You may need to define some global variables or a struct to store your job queue elements. 
-*/
-typedef struct _job_t
-{
-    int job_number;
-    int priority;
-    int running_time;
-    int start_time;
-    int is_running;
-    int time;
-    int core;
-    int firsty; //1 = it has been seen before
-    int response_time; //when it first got some time in a core
-    int waiting_time;
-    int when_preempted;
-    int first_time;
-} job_t;
+#include "../libhistogram/libhistogram.h"
 
 /**
  * Just a collection of variables that would otherwise
- * have to be declared global individually.
+ * have to be declared global individually. Each scheduler_t is one of
+ * these, so any number of schedulers can run side by side.
  */
 typedef struct _details_t {
-  int *corelist; //1 = corelist[index] is in use; 0 = not in use
+  unsigned long long *idle; //bit index%64 of idle[index/64] is set while core index is idle
+  int num_idle;
+  job_t **running; //running[index] = the job on core index, if any
   scheme_t sch;
-  priqueue_t *thing;
+  priqueue_t *thing; //jobs waiting for a core, one queue per level; running ones are only in running
+  int num_levels;
+  long long *quanta; //MLFQ: quanta[level] is the slice of a job on that level; otherwise NULL
+  long long boost; //MLFQ: how often waiting jobs go back to level 0, or 0 if never
+  long long next_boost;
+  long long quantum; //CFS: the minimum granularity; STRIDE and LOTTERY: every job's quantum
+  long long min_vruntime; //CFS: where a new job starts, so it cannot starve the others
+  unsigned long long seed; //LOTTERY: xorshift state, so runs can be repeated
+  long long total_weight; //of every job that has arrived and not finished
+  int num_runnable;
+  long long next_seq;
+  priqueue_t *victims; //running jobs, the one to preempt first; NULL unless PSJF or PPRI
   int num_cores;
-  int total_response_time;
-  int total_turnaround_time;
-  int total_waiting_time;
+  long long total_response_time;
+  long long total_turnaround_time;
+  long long total_waiting_time;
   int num_jobs; //stats
+  histogram_t waiting, turnaround, response; //one entry per finished job
+  pool_t jobs; //where every job_t is allocated
+  job_t **table; //every job not yet finished, by job_number; see job_find()
+  int table_slots; //a power of two
+  int table_used;
 } details_t;
 
-static details_t *ugh = NULL;
+//The scheduler behind the functions that take no scheduler_t.
+static scheduler_t *default_scheduler = NULL;
+
+//The sort key for FCFS, and the tie-breaker for SJF and PRI.
+long long key0(const void * a)
+{
+  return ((job_t*)a)->time;
+}
+
+//The sort key for PRI, with ties broken by key0().
+long long key3(const void * a)
+{
+  return ((job_t*)a)->priority;
+}
+
+//The bucket function for PRI: one bucket per priority.
+int bucket3(const void * a)
+{
+  return ((job_t*)a)->priority;
+}
+
+//The sort key for SJF, with ties broken by key0().
+long long key1(const void * a)
+{
+  return ((job_t*)a)->running_time;
+}
+
+//The sort key for CFS, STRIDE and LOTTERY, with ties broken by key0().
+long long key7(const void * a)
+{
+  return ((job_t*)a)->vruntime;
+}
+
+/**
+ * CPU shares by priority + 20, as for nice values: priority 0 gets
+ * CFS_WEIGHT0, and each step either way is worth about 25% more or less.
+ */
+#define CFS_WEIGHT0 1024
+static const int priority_weights[40] = {
+  88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
+   9548,  7620,  6100,  4904,  3906,  3121,  2501,  1991,  1586,  1277,
+   1024,   820,   655,   526,   423,   335,   272,   215,   172,   137,
+    110,    87,    70,    56,    45,    36,    29,    23,    18,    15,
+};
+
+//Priorities past either end of priority_weights[] share its last entry.
+static int priority_weight(int priority)
+{
+  if(priority < -20)
+    return priority_weights[0];
+  if(priority > 19)
+    return priority_weights[39];
+  return priority_weights[priority + 20];
+}
+
+//Compares two jobs by a key, then by key0().
+static int compare_then_time(long long ka, long long kb, const void * a, const void * b)
+{
+  if(ka != kb)
+    return ka < kb ? -1 : 1;
+  return key0(a) < key0(b) ? -1 : key0(a) > key0(b);
+}
+
+/**
+ * The job table is an open-addressing hash with linear probing, kept
+ * at most half full. Job numbers are the caller's, so they need not be
+ * small or dense. A job goes in when it arrives and comes out when it
+ * finishes; a job_t never moves and its number never changes, so
+ * preemption and quantum expiry leave the table alone.
+ */
+#define JOB_TABLE_SLOTS 64
+
+//The slot where job_number's probe sequence starts.
+static int job_slot(scheduler_t *ugh, int job_number)
+{
+  return (int)(((unsigned int) job_number * 0x9E3779B97F4A7C15ULL) >> 32) & (ugh->table_slots - 1);
+}
+
+//The slot holding job_number, or the empty slot where it would go.
+static int job_probe(scheduler_t *ugh, int job_number)
+{
+  int slot = job_slot(ugh, job_number);
+
+  while(ugh->table[slot] && ugh->table[slot]->job_number != job_number)
+    slot = (slot + 1) & (ugh->table_slots - 1);
+
+  return slot;
+}
+
+//The unfinished job numbered job_number, or NULL.
+static job_t *job_find(scheduler_t *ugh, int job_number)
+{
+  return ugh->table[job_probe(ugh, job_number)];
+}
+
+static void job_insert(scheduler_t *ugh, job_t *job)
+{
+  int i, slots = ugh->table_slots;
+  job_t **old = ugh->table;
+
+  if(2 * (ugh->table_used + 1) > slots) {
+    ugh->table_slots *= 2;
+    ugh->table = (job_t **) calloc(ugh->table_slots, sizeof(job_t *));
+    for(i = 0; i < slots; i++)
+      if(old[i])
+        ugh->table[job_probe(ugh, old[i]->job_number)] = old[i];
+    free(old);
+  }
+
+  ugh->table[job_probe(ugh, job->job_number)] = job;
+  ugh->table_used++;
+}
+
+/**
+ * Empties the job's slot, then shifts back any later job of the same
+ * run whose probe would otherwise cross the hole.
+ */
+static void job_erase(scheduler_t *ugh, job_t *job)
+{
+  int mask = ugh->table_slots - 1;
+  int hole = job_probe(ugh, job->job_number), slot = hole, home;
+
+  ugh->table[hole] = NULL;
+  ugh->table_used--;
+
+  while(ugh->table[slot = (slot + 1) & mask]) {
+    home = job_slot(ugh, ugh->table[slot]->job_number);
+    if(((slot - home) & mask) >= ((slot - hole) & mask)) {
+      ugh->table[hole] = ugh->table[slot];
+      ugh->table[slot] = NULL;
+      hole = slot;
+    }
+  }
+}
+
+
+/**
+ * Breaks a tie between two running jobs the way one queue of every job,
+ * running or not, used to: by when each last joined it, on arrival or
+ * when put back after a preemption or expiry. The job that joined first
+ * comes first, unless last is set.
+ */
+static int job_seq(const void * a, const void * b, int last)
+{
+  long long sa = ((job_t*)a)->seq, sb = ((job_t*)b)->seq;
+
+  if(sa == sb)
+    return 0;
+  return (sa < sb) != last ? -1 : 1;
+}
+
+/**
+ * Orders running jobs for PSJF: the one finishing last, which has the
+ * most time remaining, comes first. Ties go to the job that would come
+ * first in the queue.
+ */
+int victim2(const void * a, const void * b)
+{
+  long long fa = ((job_t*)a)->start_time + ((job_t*)a)->running_time;
+  long long fb = ((job_t*)b)->start_time + ((job_t*)b)->running_time;
+  int cmp;
+
+  if(fa != fb)
+    return fa > fb ? -1 : 1;
+  cmp = compare_then_time(key1(a), key1(b), a, b);
+  return cmp ? cmp : job_seq(a, b, 0);
+}
+
+/**
+ * Orders running jobs for PPRI: the lowest priority comes first. Ties go
+ * to the job that would come last in the queue.
+ */
+int victim4(const void * a, const void * b)
+{
+  int cmp = compare_then_time(key3(b), key3(a), b, a);
+
+  return cmp ? cmp : job_seq(a, b, 1);
+}
+
+/**
+ * Orders running jobs for MLFQ: the one on the lowest level comes first.
+ * Ties go to the job that would come last in the queue.
+ */
+int victim6(const void * a, const void * b)
+{
+  return compare_then_time(((job_t*)b)->level, ((job_t*)a)->level, b, a);
+}
+
+//Makes job a candidate for preemption, now that it has a core.
+static void victims_offer(scheduler_t *ugh, job_t *job)
+{
+  if(ugh->victims)
+    job->handle = priqueue_offer_handle(ugh->victims, job);
+}
+
+//Withdraws job from preemption, now that it is leaving its core.
+static void victims_remove(scheduler_t *ugh, job_t *job)
+{
+  if(ugh->victims)
+    priqueue_remove_handle(ugh->victims, job->handle);
+}
+
+
+//Puts job at the back of its level, to wait for a core.
+static void ready_offer(scheduler_t *ugh, job_t *job)
+{
+  job->seq = ugh->next_seq++;
+  job->handle = priqueue_offer_handle(ugh->thing + job->level, job);
+}
+
+/**
+ * Moves a PRI queue from its buckets to the tree, in the same order, the
+ * first time a job arrives with a priority the buckets do not cover.
+ * Such jobs would all share an end bucket, where every offer is linear.
+ */
+static void ready_widen(scheduler_t *ugh, job_t *job)
+{
+  int i, n;
+  job_t **waiting;
+
+  if(ugh->thing->kind != PRIQUEUE_BUCKET || ugh->thing->bucket_of != bucket3 ||
+      (job->priority >= 0 && job->priority < PRIORITY_BUCKETS))
+    return;
+
+  n = priqueue_size(ugh->thing);
+  waiting = (job_t **) malloc(sizeof(job_t *) * (n + 1));
+  for(i = 0; i < n; i++)
+    waiting[i] = (job_t *) priqueue_poll(ugh->thing);
+
+  priqueue_destroy(ugh->thing);
+  priqueue_init(ugh->thing, NULL);
+  priqueue_set_keys(ugh->thing, key3, key0);
+  for(i = 0; i < n; i++)
+    waiting[i]->handle = priqueue_offer_handle(ugh->thing, waiting[i]);
+
+  free(waiting);
+}
+
+//Takes the next job to run from the highest level that has one, or NULL.
+static job_t *ready_poll(scheduler_t *ugh)
+{
+  int level = 0;
+
+  while(level < ugh->num_levels - 1 && !priqueue_size(ugh->thing + level))
+    level++;
+
+  return (job_t *) priqueue_poll(ugh->thing + level);
+}
+
+
+/**
+ * The levels an MLFQ scheduler starts with, along with a boost every
+ * MLFQ_BOOST; a job's quantum doubles each time it drops a level.
+ */
+#define MLFQ_LEVELS 3
+static const long long mlfq_quanta[MLFQ_LEVELS] = {1, 2, 4};
 
-//The comparison function for FCFS.
-int compare0(const void * a, const void * b)
+/**
+ * Moves every job waiting below level 0 to the back of level 0, highest
+ * level first, with a fresh quantum. Without this a job that has used up
+ * its quanta could starve under a steady stream of short ones. Running
+ * jobs keep their level until they next wait.
+ */
+static void mlfq_boost(scheduler_t *ugh, long long time)
 {
-  return ( ((job_t*)a)->time - ((job_t*)b)->time );
+  int level;
+  job_t *job;
+
+  for(level = 1; level < ugh->num_levels; level++)
+    while((job = (job_t *) priqueue_poll(ugh->thing + level))) {
+      job->level = 0;
+      job->slice = ugh->quanta[0];
+      ready_offer(ugh, job);
+    }
+
+  ugh->next_boost = time - time % ugh->boost + ugh->boost;
 }
 
-//The comparison function for PRI.
-int compare3(const void * a, const void * b)
+//Boosts, if a multiple of the boost period has passed since the last one.
+static void mlfq_tick(scheduler_t *ugh, long long time)
 {
-  int pridiff = ( ((job_t*)a)->priority - ((job_t*)b)->priority );
+  if(ugh->boost && time >= ugh->next_boost)
+    mlfq_boost(ugh, time);
+}
+
+
+/**
+ * CFS spreads this many minimum granularities over the runnable jobs,
+ * by weight, before any one runs again; with more jobs than that, each
+ * gets at least the minimum granularity.
+ */
+#define CFS_LATENCY 8
+
+/**
+ * The virtual runtime a job of weight CFS_WEIGHT0 gains per time unit.
+ * Lighter jobs gain more, so over time each runs in proportion to its
+ * weight; under STRIDE this divided by the weight is the job's stride.
+ */
+#define STRIDE1 (CFS_WEIGHT0 << 10)
 
-  return pridiff == 0 ? compare0(a, b) : pridiff;
+//Adds the time job has just run to its virtual runtime.
+static void vruntime_charge(job_t *job, long long ran)
+{
+  job->vruntime += ran * STRIDE1 / job->weight;
 }
 
-//The comparison function for SJF.
-int compare1(const void * a, const void * b)
+/**
+ * A pass for a LOTTERY job about to wait: min_vruntime plus a random
+ * draw, exponential with a rate proportional to the job's weight. The
+ * lowest pass then belongs to each waiting job with probability its
+ * weight over theirs, as if it held that share of the tickets. Draws are
+ * memoryless, so the passes of jobs already waiting stay fair.
+ */
+static long long lottery_pass(scheduler_t *ugh, job_t *job)
 {
-  int remtm = ( ((job_t*)a)->running_time - ((job_t*)b)->running_time );
+  unsigned long long x = ugh->seed;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  ugh->seed = x;
 
-  return remtm == 0 ? compare0(a, b) : remtm;
+  double u = ((x >> 11) + 1) / 9007199254740992.0; //(0, 1]
+  return ugh->min_vruntime + (long long)(-log(u) * STRIDE1 / job->weight);
 }
 
-//For RR. Every new entry goes to the end
-int compare5(const void * a, const void * b) {
-  return -1;
+//Works out a job's quantum as it gets a core, for the schemes that do.
+static void slice_start(scheduler_t *ugh, job_t *job)
+{
+  if(ugh->sch == STRIDE || ugh->sch == LOTTERY)
+    job->slice = ugh->quantum;
+  else if(ugh->sch == CFS) {
+    int n = ugh->num_runnable > CFS_LATENCY ? ugh->num_runnable : CFS_LATENCY;
+    job->slice = ugh->quantum * n * job->weight / ugh->total_weight;
+    if(job->slice < ugh->quantum)
+      job->slice = ugh->quantum;
+  }
+  else
+    return;
+
+  if(job->vruntime > ugh->min_vruntime)
+    ugh->min_vruntime = job->vruntime;
 }
 
+
+//Bits in one word of the idle core bitmap.
+#define CORE_BITS 64
+
+static void core_idle(scheduler_t *ugh, int core_id)
+{
+  ugh->idle[core_id / CORE_BITS] |= 1ULL << (core_id % CORE_BITS);
+  ugh->num_idle++;
+}
+
+static void core_busy(scheduler_t *ugh, int core_id)
+{
+  ugh->idle[core_id / CORE_BITS] &= ~(1ULL << (core_id % CORE_BITS));
+  ugh->num_idle--;
+}
+
+//The lowest idle core; only to be asked while num_idle is nonzero.
+static int core_first_idle(scheduler_t *ugh)
+{
+  int word = 0;
+
+  while(!ugh->idle[word])
+    word++;
+
+  return word * CORE_BITS + __builtin_ctzll(ugh->idle[word]);
+}
+
+
 /** 
-  Initalizes the scheduler.
+  Creates a scheduler.
+
+  Schedulers share no state, so different threads may each use their own
+  at the same time; any one scheduler must only be used by one thread at
+  a time.
  
   Assumptions:
-    - You may assume this will be the first scheduler function called.
-    - You may assume this function will be called only once.
     - You may assume that cores is a positive, non-zero number.
     - You may assume that scheme is a valid scheduling scheme.
 
   @param cores the number of cores that is available by the scheduler. 
   These cores will be known as core(id=0), core(id=1), ..., core(id=cores-1).
   @param scheme  the scheduling scheme that should be used. This value will be
-   one of the six enum values of scheme_t
+   one of the enum values of scheme_t
+  @return the new scheduler, to be passed to the other scheduler_*_r()
+  functions and finally to scheduler_destroy()
 */
-void scheduler_start_up(int cores, scheme_t scheme)
+scheduler_t *scheduler_create(int cores, scheme_t scheme)
 {
-  ugh = (details_t *) malloc(sizeof(details_t));
+  scheduler_t *ugh = (scheduler_t *) malloc(sizeof(scheduler_t));
   ugh->thing = (priqueue_t *) malloc(sizeof(priqueue_t));
-  ugh->corelist = (int *) malloc(sizeof(int) * (ugh->num_cores = cores));
+  ugh->num_levels = 1;
+  ugh->quanta = NULL;
+  ugh->boost = 0;
+  ugh->quantum = 1;
+  ugh->min_vruntime = 0;
+  ugh->seed = 88172645463325252ULL;
+  ugh->total_weight = 0;
+  ugh->num_runnable = 0;
+  ugh->next_seq = 0;
+  ugh->victims = NULL;
+  ugh->idle = (unsigned long long *) calloc((cores + CORE_BITS - 1) / CORE_BITS, sizeof(unsigned long long));
+  ugh->num_idle = 0;
+  ugh->num_cores = cores;
+  ugh->running = (job_t **) malloc(sizeof(job_t *) * cores);
+  pool_init(&ugh->jobs, sizeof(job_t), 64);
+  histogram_init(&ugh->waiting);
+  histogram_init(&ugh->turnaround);
+  histogram_init(&ugh->response);
+  ugh->table = (job_t **) calloc(ugh->table_slots = JOB_TABLE_SLOTS, sizeof(job_t *));
+  ugh->table_used = 0;
 
   ugh->total_response_time = 
   ugh->total_turnaround_time = 
@@ -105,29 +472,115 @@ void scheduler_start_up(int cores, scheme_t scheme)
    * 3 = PRI
    * 4 = PPRI
    * 5 = RR
+   * 6 = MLFQ
+   * 7 = CFS
+   * 8 = STRIDE
+   * 9 = LOTTERY
    */
   /**
    * Different schemes have different notions of priority. The
    * preemptive versions of schemes are in principle the same.
+   * The queue is walked by index on every event, so it sits on the
+   * tree, where priqueue_at() is logarithmic. FCFS keys arrive in
+   * order, so it gets buckets instead, and so does PRI, whose keys are
+   * usually small integers, until one is not; see ready_widen().
+   * RR only ever appends, so it needs no order at all, and neither does
+   * each level of MLFQ. CFS orders by virtual runtime on the tree, as
+   * SJF does by running time, and STRIDE and LOTTERY by pass. The rest
+   * compare integer keys rather than calling a comparer.
    */
   switch(scheme) {
-    case FCFS: priqueue_init(ugh->thing, compare0);
+    case FCFS: priqueue_init_bucket(ugh->thing, NULL, NULL, 1);
+            priqueue_set_key(ugh->thing, key0);
             break;
     case SJF:
-    case PSJF: priqueue_init(ugh->thing, compare1);
+    case PSJF: priqueue_init(ugh->thing, NULL);
+            priqueue_set_keys(ugh->thing, key1, key0);
             break;
     case PRI:
-    case PPRI: priqueue_init(ugh->thing, compare3);
+    case PPRI: priqueue_init_bucket(ugh->thing, NULL, bucket3, PRIORITY_BUCKETS);
+            priqueue_set_keys(ugh->thing, key3, key0);
+            break;
+    case RR: priqueue_init_kind(ugh->thing, NULL, PRIQUEUE_FIFO);
+            break;
+    case MLFQ: priqueue_init_kind(ugh->thing, NULL, PRIQUEUE_FIFO);
+            scheduler_set_mlfq_r(ugh, MLFQ_LEVELS, mlfq_quanta, MLFQ_BOOST);
+            break;
+    case CFS:
+    case STRIDE:
+    case LOTTERY: priqueue_init(ugh->thing, NULL);
+            priqueue_set_keys(ugh->thing, key7, key0);
             break;
-    case RR: priqueue_init(ugh->thing, compare5);
     default: break;
   }
 
+  /**
+   * The preemptive schemes also keep their running jobs in a heap, the
+   * one to preempt first on top, so choosing it is only a peek.
+   */
+  if(scheme == PSJF || scheme == PPRI || scheme == MLFQ) {
+    ugh->victims = (priqueue_t *) malloc(sizeof(priqueue_t));
+    priqueue_init_kind(ugh->victims, scheme == PSJF ? victim2 : scheme == PPRI ? victim4 : victim6, PRIQUEUE_HEAP);
+  }
+
   int i;
-  for(i = 0; i < ugh->num_cores; i++)
-    ugh->corelist[i] = 0; //Every core is initially idle.
+  for(i = 0; i < ugh->num_cores; i++) {
+    core_idle(ugh, i); //Every core is initially idle.
+    ugh->running[i] = NULL;
+  }
 
   ugh->sch = scheme;
+  return ugh;
+}
+
+
+/**
+  Gives an MLFQ scheduler its levels and boost, replacing the MLFQ_LEVELS
+  and MLFQ_BOOST it was created with.
+
+  Assumptions:
+    - You may assume that ugh was created with the MLFQ scheme and that no
+      job has arrived yet.
+
+  @param ugh the scheduler, as returned by scheduler_create()
+  @param levels the number of queues, at least 1
+  @param quanta quanta[i] is how long a job on level i runs before it drops
+         to level i+1; the last level keeps its jobs
+  @param boost every multiple of this time, the jobs waiting below level 0
+         move back up to it; 0 never moves them
+ */
+void scheduler_set_mlfq_r(scheduler_t *ugh, int levels, const long long *quanta, long long boost)
+{
+  int i;
+  for(i = 0; i < ugh->num_levels; i++)
+    priqueue_destroy(ugh->thing + i);
+  free(ugh->thing);
+  free(ugh->quanta);
+
+  ugh->thing = (priqueue_t *) malloc(sizeof(priqueue_t) * levels);
+  ugh->quanta = (long long *) malloc(sizeof(long long) * levels);
+  for(i = 0; i < levels; i++) {
+    priqueue_init_kind(ugh->thing + i, NULL, PRIQUEUE_FIFO);
+    ugh->quanta[i] = quanta[i];
+  }
+
+  ugh->num_levels = levels;
+  ugh->boost = boost;
+  ugh->next_boost = boost;
+}
+
+
+/**
+  Sets the minimum granularity of a CFS scheduler: no job gets a shorter
+  quantum, however many are runnable. For STRIDE and LOTTERY, sets every
+  job's quantum. It is 1 until this is called.
+
+  @param ugh the scheduler, as returned by scheduler_create()
+  @param quantum a positive number of time units
+ */
+void scheduler_set_quantum_r(scheduler_t *ugh, long long quantum)
+{
+  ugh->quantum = quantum;
 }
 
 
@@ -143,6 +596,7 @@ void scheduler_start_up(int cores, scheme_t scheme)
   Assumptions:
     - You may assume that every job wil have a unique arrival time.
 
+  @param ugh the scheduler, as returned by scheduler_create()
   @param job_number a globally unique identification number of the job 
   arriving.
   @param time the current time of the simulator.
@@ -155,49 +609,64 @@ void scheduler_start_up(int cores, scheme_t scheme)
  
  */
 
-int scheduler_new_job(int job_number, int time, int running_time, int priority)
+int scheduler_new_job_r(scheduler_t *ugh, int job_number, long long time, long long running_time, int priority)
 {
+  mlfq_tick(ugh, time);
   ugh->num_jobs++;
 
-  job_t *job = (job_t *) malloc(sizeof(job_t));
+  job_t *job = (job_t *) pool_alloc(&ugh->jobs);
   job->job_number = job_number;
   job->priority = priority;
   job->running_time = running_time;
   job->time = time; 
+  job->arrival = time;
   job->start_time = -1;
   job->first_time = -1;
-  job->is_running =
   job->firsty =
   job->response_time =
   job->waiting_time = 0;
   job->when_preempted = time;
+  job->level = 0;
+  job->slice = ugh->quanta ? ugh->quanta[0] : -1;
+  job->weight = priority_weight(priority);
+  job->vruntime = ugh->sch == LOTTERY ? lottery_pass(ugh, job) : ugh->min_vruntime;
+  ugh->total_weight += job->weight;
+  ugh->num_runnable++;
+  job->seq = ugh->next_seq++;
 
   job->core = -1; //no core has been assigned to it yet
+  ready_widen(ugh, job);
 
-  priqueue_offer(ugh->thing, job); 
+  job_insert(ugh, job);
 
   //Look for an idle core
   int i;
-  for(i=0; i<ugh->num_cores; i++)
-    if(!ugh->corelist[i]) {
-      ugh->corelist[i] = 1; //The core is now in use
-      job->is_running = 1; //is being performed
-      job->firsty = 1;
-      job->start_time = time;
-      job->first_time = time;
-      job->response_time = 0;//time - job->time + 1;
-      return job->core = i; //The id of the core to which job has been assigned.
-    }
+  if(ugh->num_idle) {
+    i = core_first_idle(ugh);
+    core_busy(ugh, i); //The core is now in use
+    job->firsty = 1;
+    job->start_time = time;
+    job->first_time = time;
+    job->response_time = 0;//time - job->time + 1;
+    ugh->running[i] = job;
+    slice_start(ugh, job);
+    victims_offer(ugh, job); //once its start time is set
+    return job->core = i; //The id of the core to which job has been assigned.
+  }
 
-    if(ugh->sch/3 + ugh->sch%3 < 2 || ugh->sch == RR) return -1; //returns if nonpreemptive or RR
+  if(!ugh->victims) { //returns if nonpreemptive or RR
+    ready_offer(ugh, job);
+    return -1;
+  }
   
 	/**
      * If there be no idle cores, use the power of preemption.
      * (Nonpreemptive jobs return -1 at the end of this function.)
      */
 
-    //rt = REMAINING time, not running time; pt = priority
-    int index, rt, lrt = -1, thindex = -1, pt, mpt = -1;
+    //lrt = REMAINING time, not running time; mpt = priority
+    long long lrt;
+    int mpt;
     job_t *curr;
 
     /**
@@ -209,60 +678,32 @@ int scheduler_new_job(int job_number, int time, int running_time, int priority)
      * 
      * One must remember that these schemes are like the nonpreemptive
      * ones insomuch as there be no conflicts with jobs that are running.
-     */
-    if(ugh->sch == PSJF) {
-        /**
-         * Finding the largest remaining time of a running job and the index of the job
-         * to which it belongs.
-         */
-	    for(index = 0; index < priqueue_size(ugh->thing); index++)
-            if( ((job_t *) priqueue_at(ugh->thing, index))->is_running) {
-                curr = (job_t *) priqueue_at(ugh->thing, index);
-			
-				if(lrt < (rt = curr->running_time - time + curr->start_time)) {
-                    lrt = rt;
-                    thindex = index;
-                }
-		    }
-    }
-    /**
+     *
      * PREEMPTIVE PRIORITY THING:
      * Similar to PSJF, except the basis for preemption is priority.
+     *
+     * MULTILEVEL FEEDBACK QUEUE:
+     * New jobs start on level 0, so they preempt a job that has dropped
+     * below it. That job keeps what is left of its quantum.
+     *
+     * Either way the running job to preempt, if any, is the one on top
+     * of victims: see victim2(), victim4() and victim6().
      */
-    else if(ugh->sch == PPRI) {
-        /**
-         * Finding the largest priority number or lowest priority of a running job 
-         * and the index of the job to which it belongs.
-         */
-        for(index = 0; index < priqueue_size(ugh->thing); index++)
-            if( ((job_t *) priqueue_at(ugh->thing, index))->is_running) {
-                curr = (job_t *) priqueue_at(ugh->thing, index);
-            
-                if(mpt <= (pt = curr->priority)) {
-                    lrt = curr->running_time - time + curr->start_time;
-                    mpt = pt;
-                    thindex = index;
-                }
-            }
-    }
-        
-
-    /**
-     * thindex is the index of the job with the largest remaining time/priority number
-     * that is currently running. It is this job that the new job must
-     * attempt to preempt.
-     */
-
-    curr = priqueue_at(ugh->thing, thindex);
+    curr = (job_t *) priqueue_peek(ugh->victims);
+    lrt = curr->running_time - time + curr->start_time;
+    mpt = curr->priority;
 
     if( (ugh->sch == PSJF && job->running_time < lrt) ||
-        (ugh->sch == PPRI && job->priority < mpt) ) {
+        (ugh->sch == PPRI && job->priority < mpt) ||
+        (ugh->sch == MLFQ && job->level < curr->level) ) {
         
+        victims_remove(ugh, curr);
         job->core = curr->core; //assign job to run on the preempted job's core
-        priqueue_remove_at(ugh->thing, thindex); //remove curr from the queue in order to fix its stats
+        ugh->running[job->core] = job;
         curr->running_time = lrt; //change its running time to be the remaining time
-        curr->is_running = 0; //remember that it is no longer running
-        job->is_running = job->firsty = 1;
+        if(curr->slice > 0)
+          curr->slice -= time - curr->start_time;
+        job->firsty = 1;
         job->response_time = 0; //time - job->time + 1;
         curr->core = -1; //it is not running on any cores
         curr->when_preempted = time;
@@ -271,15 +712,44 @@ int scheduler_new_job(int job_number, int time, int running_time, int priority)
             curr->firsty = 0;
         }
         job->start_time = time;
-        priqueue_offer(ugh->thing, curr); //put it back into the priority queue
+        victims_offer(ugh, job);
+        ready_offer(ugh, curr); //back in line, by its remaining time
         return job->core; //return the core on which job is to be run
     }
     
+    ready_offer(ugh, job);
     return -1; //job needs to wait in line like everyone else
 
 }
 
 
+/**
+ * Gives core_id to the job at the head of the queue, if there is one.
+ * Returns its job_number, or -1 if the core should remain idle.
+ */
+static int job_dispatch(scheduler_t *ugh, int core_id, long long time)
+{
+  job_t *next = ready_poll(ugh);
+
+  if(!next)
+    return -1;
+
+  next->core = core_id;
+  core_busy(ugh, core_id);
+  ugh->running[core_id] = next;
+  next->waiting_time += time - next->when_preempted;
+  if(!next->firsty) {
+    next->firsty = 1;
+    next->first_time = time;
+    next->response_time = time - next->time;
+  }
+  next->start_time = time;
+  slice_start(ugh, next);
+  victims_offer(ugh, next);
+  return next->job_number;
+}
+
+
 /**
   Called when a job has completed execution.
  
@@ -289,137 +759,121 @@ int scheduler_new_job(int job_number, int time, int running_time, int priority)
   finished job, return the job_number of the job that should be scheduled to
   run on core core_id.
  
+  @param ugh the scheduler, as returned by scheduler_create()
   @param core_id the zero-based index of the core where the job was located.
   @param job_number a globally unique identification number of the job.
   @param time the current time of the simulator.
   @return job_number of the job that should be scheduled to run on core core_id
   @return -1 if core should remain idle.
  */
-int scheduler_job_finished(int core_id, int job_number, int time)
+int scheduler_job_finished_r(scheduler_t *ugh, int core_id, int job_number, long long time)
 {
   /**
    * The current assumption is that this function works similarly for
    * every scheme. Preemption occurs when a new job arrives.
    */
 
-  job_t *done; //the finished job
-  job_t *next = NULL;
+  mlfq_tick(ugh, time);
+  job_t *done = job_find(ugh, job_number); //the finished job
   
   //The core is now idle
-  ugh->corelist[core_id] = 0;
-  int index;
-  for(index = 0; index < priqueue_size(ugh->thing); index++) 
-    if( ((job_t *) priqueue_at(ugh->thing, index))->job_number == job_number) {
-    	done = (job_t *) priqueue_at(ugh->thing, index);
-		break;
-	}
-            
-  priqueue_remove_at(ugh->thing, index);
+  core_idle(ugh, core_id);
+  ugh->running[core_id] = NULL;
+
+  victims_remove(ugh, done);
+  job_erase(ugh, done);
+  ugh->total_weight -= done->weight;
+  ugh->num_runnable--;
   
   //temporal statistics are calculated only when a job is done
   ugh->total_response_time += done->response_time;
   ugh->total_turnaround_time += time - done->time;
   ugh->total_waiting_time += done->waiting_time;
+  histogram_record(&ugh->response, done->response_time);
+  histogram_record(&ugh->turnaround, time - done->arrival);
+  histogram_record(&ugh->waiting, done->waiting_time);
 
-  free(done);
-            
-  for(index = 0; index < priqueue_size(ugh->thing); index++)
-    if( !((job_t *) priqueue_at(ugh->thing, index))->is_running) {
-        next = (job_t *) priqueue_at(ugh->thing, index);
-        break;
-    }
-          
-    if(next) {
-	   next->core = core_id;
-	   ugh->corelist[core_id] = 1;
-	   next->is_running = 1;
-       next->waiting_time += time - next->when_preempted;
-       if(!next->firsty) {
-            next->firsty = 1;
-            next->first_time = time;
-            next->response_time = time - next->time;
-        }
-        next->start_time = time;
-       return next->job_number;
-    }
-   
-    //The core should remain idle, such as for instance when the queue is empty.
-	
-	return -1;
+  pool_free(&ugh->jobs, done);
+
+  //The core remains idle if the queue is empty.
+  return job_dispatch(ugh, core_id, time);
 }
 
 
 /**
-  When the scheme is set to RR, called when the quantum timer has expired
-  on a core.
+  When the scheme gives jobs a quantum (RR, MLFQ, CFS, STRIDE and
+  LOTTERY), called when the quantum timer has expired on a core. Under
+  MLFQ the job then drops a level, unless it is already on the last;
+  under CFS and STRIDE it is charged for the time it ran, and under
+  LOTTERY it draws a new pass.
  
   If any job should be scheduled to run on the core free'd up by
   the quantum expiration, return the job_number of the job that should be
   scheduled to run on core core_id.
 
+  @param ugh the scheduler, as returned by scheduler_create()
   @param core_id the zero-based index of the core where the quantum has expired.
   @param time the current time of the simulator. 
   @return job_number of the job that should be scheduled on core cord_id
   @return -1 if core should remain idle
  */
-int scheduler_quantum_expired(int core_id, int time)
+int scheduler_quantum_expired_r(scheduler_t *ugh, int core_id, long long time)
 {
 /**
    * The current assumption is that this function works similarly for
    * every scheme. Preemption occurs when a new job arrives.
    */
 
-  job_t *done; //the finished job
-  job_t *next = NULL;
+  mlfq_tick(ugh, time);
+  job_t *done = ugh->running[core_id]; //the job whose quantum expired
   
   //The core is now idle
-  ugh->corelist[core_id] = 0;
-  int index;
-  for(index = 0; index < priqueue_size(ugh->thing); index++) 
-    if( ((job_t *) priqueue_at(ugh->thing, index))->core == core_id) {
-        done = (job_t *) priqueue_at(ugh->thing, index);
-        break;
-    }
-            
-  priqueue_remove_at(ugh->thing, index);
+  core_idle(ugh, core_id);
+  ugh->running[core_id] = NULL;
   
   //temporal statistics are calculated only when a job is done
  // ugh->total_response_time += done->response_time;
   ugh->total_turnaround_time += time - done->time;
  // ugh->total_waiting_time += done->waiting_time;
 
+  victims_remove(ugh, done);
   done->when_preempted = time;
-  done->is_running = 0;
   done->core = -1;
+  if(ugh->sch == CFS || ugh->sch == STRIDE)
+    vruntime_charge(done, time - done->start_time);
+  else if(ugh->sch == LOTTERY)
+    done->vruntime = lottery_pass(ugh, done);
   done->running_time = done->running_time - time + done->start_time;
 
   done->time = time;
+  if(ugh->quanta) {
+    if(done->level < ugh->num_levels - 1)
+      done->level++;
+    done->slice = ugh->quanta[done->level];
+  }
 
-  priqueue_offer(ugh->thing, done);
-            
-  for(index = 0; index < priqueue_size(ugh->thing); index++)
-    if( !((job_t *) priqueue_at(ugh->thing, index))->is_running) {
-        next = (job_t *) priqueue_at(ugh->thing, index);
-        break;
-    }
-          
-    if(next) {
-       next->core = core_id;
-       ugh->corelist[core_id] = 1;
-       next->is_running = 1;
-       next->waiting_time += time - next->when_preempted;
-       if(!next->firsty) {
-            next->firsty = 1;
-            next->first_time = time;
-            next->response_time = time - next->time;
-        }
-        next->start_time = time;
-        return next->job_number;
-    }
-   
-    //The core should remain idle, such as for instance when the queue is empty.
-    
-    return -1;
+  //To the back of the line, behind everyone already waiting
+  ready_offer(ugh, done);
+
+  //The core remains idle if the queue is empty.
+  return job_dispatch(ugh, core_id, time);
+}
+
+
+/**
+  Returns how long the job now on core_id may run before
+  scheduler_quantum_expired_r() should be called for it. Ask each time
+  the core is given a job. RR jobs have no limit here: the caller chooses
+  their quantum.
+
+  @param ugh the scheduler, as returned by scheduler_create()
+  @param core_id the zero-based index of the core
+  @return the time left in the job's quantum, or -1 if it may run until it
+  finishes or is preempted, or if the core is idle
+ */
+long long scheduler_quantum_r(scheduler_t *ugh, int core_id)
+{
+  return ugh->running[core_id] ? ugh->running[core_id]->slice : -1;
 }
 
 
@@ -428,11 +882,12 @@ int scheduler_quantum_expired(int core_id, int time)
 
   Assumptions:
     - This function will only be called after all scheduling is complete (all jobs that have arrived will have finished and no new jobs will arrive).
+  @param ugh the scheduler, as returned by scheduler_create()
   @return the average waiting time of all jobs scheduled.
  */
-float scheduler_average_waiting_time()
+double scheduler_average_waiting_time_r(scheduler_t *ugh)
 {
-	return ugh->total_waiting_time / ((float) ugh->num_jobs);
+	return ugh->total_waiting_time / ((double) ugh->num_jobs);
 }
 
 
@@ -441,11 +896,12 @@ float scheduler_average_waiting_time()
 
   Assumptions:
     - This function will only be called after all scheduling is complete (all jobs that have arrived will have finished and no new jobs will arrive).
+  @param ugh the scheduler, as returned by scheduler_create()
   @return the average turnaround time of all jobs scheduled.
  */
-float scheduler_average_turnaround_time()
+double scheduler_average_turnaround_time_r(scheduler_t *ugh)
 {
-	return ugh->total_turnaround_time / ((float) ugh->num_jobs);
+	return ugh->total_turnaround_time / ((double) ugh->num_jobs);
 }
 
 
@@ -454,11 +910,57 @@ float scheduler_average_turnaround_time()
 
   Assumptions:
     - This function will only be called after all scheduling is complete (all jobs that have arrived will have finished and no new jobs will arrive).
+  @param ugh the scheduler, as returned by scheduler_create()
   @return the average response time of all jobs scheduled.
  */
-float scheduler_average_response_time()
+double scheduler_average_response_time_r(scheduler_t *ugh)
+{
+	return ugh->total_response_time / ( (double) ugh->num_jobs);
+}
+
+
+/**
+  Returns the waiting time that the given percentage of finished jobs
+  waited no longer than.
+
+  Times are kept in histograms, so ones of 128 or more may read up to
+  1/64th high; the 100th percentile is always exact.
+
+  @param ugh the scheduler, as returned by scheduler_create()
+  @param percentile a percentage from 0 to 100
+  @return the waiting time at that percentile, or 0 if no job has finished
+ */
+long long scheduler_percentile_waiting_time_r(scheduler_t *ugh, double percentile)
 {
-	return ugh->total_response_time / ( (float) ugh->num_jobs);
+	return histogram_percentile(&ugh->waiting, percentile);
+}
+
+
+/**
+  Returns the turnaround time at the given percentile of finished jobs;
+  see scheduler_percentile_waiting_time_r().
+
+  @param ugh the scheduler, as returned by scheduler_create()
+  @param percentile a percentage from 0 to 100
+  @return the turnaround time at that percentile, or 0 if no job has finished
+ */
+long long scheduler_percentile_turnaround_time_r(scheduler_t *ugh, double percentile)
+{
+	return histogram_percentile(&ugh->turnaround, percentile);
+}
+
+
+/**
+  Returns the response time at the given percentile of finished jobs;
+  see scheduler_percentile_waiting_time_r().
+
+  @param ugh the scheduler, as returned by scheduler_create()
+  @param percentile a percentage from 0 to 100
+  @return the response time at that percentile, or 0 if no job has finished
+ */
+long long scheduler_percentile_response_time_r(scheduler_t *ugh, double percentile)
+{
+	return histogram_percentile(&ugh->response, percentile);
 }
 
 
@@ -466,13 +968,24 @@ float scheduler_average_response_time()
   Free any memory associated with your scheduler.
  
   Assumptions:
-    - This function will be the last function called in your library.
+    - This function will be the last function called on ugh.
+  @param ugh the scheduler, as returned by scheduler_create()
 */
-void scheduler_clean_up()
+void scheduler_destroy(scheduler_t *ugh)
 {
-    priqueue_destroy(ugh->thing);
+    int i;
+    for(i = 0; i < ugh->num_levels; i++)
+      priqueue_destroy(ugh->thing + i);
+    if(ugh->victims) {
+      priqueue_destroy(ugh->victims);
+      free(ugh->victims);
+    }
+    pool_destroy(&ugh->jobs);
+    free(ugh->table);
     free(ugh->thing);
-    free(ugh->corelist);
+    free(ugh->quanta);
+    free(ugh->idle);
+    free(ugh->running);
     free(ugh);
 }
 
@@ -487,12 +1000,188 @@ void scheduler_clean_up()
   
   This function is not required and will not be graded. You may leave it
   blank if you do not find it useful.
+
+  Running jobs are not in the queue, so they are listed after the waiting
+  ones, in core order: the example above prints as 2(-1) 1(-1) 4(0).
+  Under MLFQ the waiting jobs are listed level by level.
+
+  @param ugh the scheduler, as returned by scheduler_create()
  */
-void scheduler_show_queue()
+void scheduler_show_queue_r(scheduler_t *ugh)
 {
-	int i;
-	for(i=0; i<priqueue_size(ugh->thing); i++)
-		printf("%d(%d) ", ( (job_t *) priqueue_at(ugh->thing, i))->job_number, ( (job_t *) priqueue_at(ugh->thing, i))->core);
+	int i, level;
+	for(level=0; level<ugh->num_levels; level++)
+		for(i=0; i<priqueue_size(ugh->thing + level); i++)
+			printf("%d(%d) ", ( (job_t *) priqueue_at(ugh->thing + level, i))->job_number, ( (job_t *) priqueue_at(ugh->thing + level, i))->core);
+
+	for(i=0; i<ugh->num_cores; i++)
+		if(ugh->running[i])
+			printf("%d(%d) ", ugh->running[i]->job_number, i);
 
 	printf("\n");
 }
+
+
+/*
+ * The functions the simulator calls. Each works on one default scheduler,
+ * created by scheduler_start_up(), so unlike the _r functions above they
+ * must not be called from more than one thread. The 64 functions take and
+ * return times as wide as the _r ones; the rest keep the original int and
+ * float types.
+ */
+
+/**
+  Initalizes the default scheduler; see scheduler_create().
+ 
+  Assumptions:
+    - You may assume this will be the first scheduler function called.
+    - You may assume this function will be called only once.
+ */
+void scheduler_start_up(int cores, scheme_t scheme)
+{
+  default_scheduler = scheduler_create(cores, scheme);
+}
+
+//See scheduler_new_job_r().
+int scheduler_new_job(int job_number, int time, int running_time, int priority)
+{
+  return scheduler_new_job_r(default_scheduler, job_number, time, running_time, priority);
+}
+
+//See scheduler_new_job_r().
+int scheduler_new_job64(int job_number, long long time, long long running_time, int priority)
+{
+  return scheduler_new_job_r(default_scheduler, job_number, time, running_time, priority);
+}
+
+//See scheduler_job_finished_r().
+int scheduler_job_finished(int core_id, int job_number, int time)
+{
+  return scheduler_job_finished_r(default_scheduler, core_id, job_number, time);
+}
+
+//See scheduler_job_finished_r().
+int scheduler_job_finished64(int core_id, int job_number, long long time)
+{
+  return scheduler_job_finished_r(default_scheduler, core_id, job_number, time);
+}
+
+//See scheduler_quantum_expired_r().
+int scheduler_quantum_expired(int core_id, int time)
+{
+  return scheduler_quantum_expired_r(default_scheduler, core_id, time);
+}
+
+//See scheduler_quantum_expired_r().
+int scheduler_quantum_expired64(int core_id, long long time)
+{
+  return scheduler_quantum_expired_r(default_scheduler, core_id, time);
+}
+
+//See scheduler_average_waiting_time_r().
+float scheduler_average_waiting_time()
+{
+  return (float) scheduler_average_waiting_time_r(default_scheduler);
+}
+
+//See scheduler_average_waiting_time_r().
+double scheduler_average_waiting_time64()
+{
+  return scheduler_average_waiting_time_r(default_scheduler);
+}
+
+//See scheduler_average_turnaround_time_r().
+float scheduler_average_turnaround_time()
+{
+  return (float) scheduler_average_turnaround_time_r(default_scheduler);
+}
+
+//See scheduler_average_turnaround_time_r().
+double scheduler_average_turnaround_time64()
+{
+  return scheduler_average_turnaround_time_r(default_scheduler);
+}
+
+//See scheduler_average_response_time_r().
+float scheduler_average_response_time()
+{
+  return (float) scheduler_average_response_time_r(default_scheduler);
+}
+
+//See scheduler_average_response_time_r().
+double scheduler_average_response_time64()
+{
+  return scheduler_average_response_time_r(default_scheduler);
+}
+
+//See scheduler_percentile_waiting_time_r().
+int scheduler_percentile_waiting_time(double percentile)
+{
+  return (int) scheduler_percentile_waiting_time_r(default_scheduler, percentile);
+}
+
+//See scheduler_percentile_waiting_time_r().
+long long scheduler_percentile_waiting_time64(double percentile)
+{
+  return scheduler_percentile_waiting_time_r(default_scheduler, percentile);
+}
+
+//See scheduler_percentile_turnaround_time_r().
+int scheduler_percentile_turnaround_time(double percentile)
+{
+  return (int) scheduler_percentile_turnaround_time_r(default_scheduler, percentile);
+}
+
+//See scheduler_percentile_turnaround_time_r().
+long long scheduler_percentile_turnaround_time64(double percentile)
+{
+  return scheduler_percentile_turnaround_time_r(default_scheduler, percentile);
+}
+
+//See scheduler_percentile_response_time_r().
+int scheduler_percentile_response_time(double percentile)
+{
+  return (int) scheduler_percentile_response_time_r(default_scheduler, percentile);
+}
+
+//See scheduler_percentile_response_time_r().
+long long scheduler_percentile_response_time64(double percentile)
+{
+  return scheduler_percentile_response_time_r(default_scheduler, percentile);
+}
+
+/**
+  Frees the default scheduler; see scheduler_destroy().
+ 
+  Assumptions:
+    - This function will be the last function called in your library.
+ */
+void scheduler_clean_up()
+{
+  scheduler_destroy(default_scheduler);
+  default_scheduler = NULL;
+}
+
+//See scheduler_show_queue_r().
+void scheduler_show_queue()
+{
+  scheduler_show_queue_r(default_scheduler);
+}
+
+//See scheduler_set_mlfq_r().
+void scheduler_set_mlfq(int levels, const long long *quanta, long long boost)
+{
+  scheduler_set_mlfq_r(default_scheduler, levels, quanta, boost);
+}
+
+//See scheduler_set_quantum_r().
+void scheduler_set_quantum(long long quantum)
+{
+  scheduler_set_quantum_r(default_scheduler, quantum);
+}
+
+//See scheduler_quantum_r().
+long long scheduler_quantum(int core_id)
+{
+  return scheduler_quantum_r(default_scheduler, core_id);
+}
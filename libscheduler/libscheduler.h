@@ -7,7 +7,19 @@
 /**
   Constants which represent the different scheduling algorithms
 */
-typedef enum {FCFS = 0, SJF, PSJF, PRI, PPRI, RR} scheme_t;
+typedef enum {FCFS = 0, SJF, PSJF, PRI, PPRI, RR, MLFQ, CFS, STRIDE, LOTTERY} scheme_t;
+
+/**
+  How often, in time units, an MLFQ scheduler moves the jobs waiting below
+  its top level back up to it, unless scheduler_set_mlfq() says otherwise.
+*/
+#define MLFQ_BOOST 50
+
+/**
+  One scheduler and all of its jobs. Any number of them can be in use at
+  once, one thread apiece.
+*/
+typedef struct _details_t scheduler_t;
 
 void  scheduler_start_up               (int cores, scheme_t scheme);
 int   scheduler_new_job                (int job_number, int time, int running_time, int priority);
@@ -16,8 +28,42 @@ int   scheduler_quantum_expired        (int core_id, int time);
 float scheduler_average_turnaround_time();
 float scheduler_average_waiting_time   ();
 float scheduler_average_response_time  ();
+int   scheduler_percentile_waiting_time   (double percentile);
+int   scheduler_percentile_turnaround_time(double percentile);
+int   scheduler_percentile_response_time  (double percentile);
 void  scheduler_clean_up               ();
 
 void  scheduler_show_queue             ();
 
+void  scheduler_set_mlfq               (int levels, const long long *quanta, long long boost);
+void  scheduler_set_quantum            (long long quantum);
+long long scheduler_quantum            (int core_id);
+
+int   scheduler_new_job64              (int job_number, long long time, long long running_time, int priority);
+int   scheduler_job_finished64         (int core_id, int job_number, long long time);
+int   scheduler_quantum_expired64      (int core_id, long long time);
+double scheduler_average_turnaround_time64();
+double scheduler_average_waiting_time64  ();
+double scheduler_average_response_time64 ();
+long long scheduler_percentile_waiting_time64   (double percentile);
+long long scheduler_percentile_turnaround_time64(double percentile);
+long long scheduler_percentile_response_time64  (double percentile);
+
+scheduler_t *scheduler_create          (int cores, scheme_t scheme);
+int   scheduler_new_job_r              (scheduler_t *ugh, int job_number, long long time, long long running_time, int priority);
+int   scheduler_job_finished_r         (scheduler_t *ugh, int core_id, int job_number, long long time);
+int   scheduler_quantum_expired_r      (scheduler_t *ugh, int core_id, long long time);
+double scheduler_average_turnaround_time_r(scheduler_t *ugh);
+double scheduler_average_waiting_time_r (scheduler_t *ugh);
+double scheduler_average_response_time_r(scheduler_t *ugh);
+long long scheduler_percentile_waiting_time_r   (scheduler_t *ugh, double percentile);
+long long scheduler_percentile_turnaround_time_r(scheduler_t *ugh, double percentile);
+long long scheduler_percentile_response_time_r  (scheduler_t *ugh, double percentile);
+void  scheduler_set_mlfq_r             (scheduler_t *ugh, int levels, const long long *quanta, long long boost);
+void  scheduler_set_quantum_r          (scheduler_t *ugh, long long quantum);
+long long scheduler_quantum_r          (scheduler_t *ugh, int core_id);
+void  scheduler_destroy                (scheduler_t *ugh);
+
+void  scheduler_show_queue_r           (scheduler_t *ugh);
+
 #endif /* LIBSCHEDULER_H_ */
@@ -0,0 +1,52 @@
+/** @file scheduler_internal.h
+ *
+ * The parts of libscheduler.c that code outside the scheduler, such as
+ * bench_priqueue, needs in order to build queues of jobs exactly as the
+ * scheduler does. Nothing here is part of the scheduler's interface.
+ */
+
+#ifndef SCHEDULER_INTERNAL_H_
+#define SCHEDULER_INTERNAL_H_
+
+#include "../libpriqueue/libpriqueue.h"
+
+/**
+  Stores information making up a job to be scheduled including any statistics.
+
+  You may need to define some global variables or a struct to store your job queue elements. 
+*/
+typedef struct _job_t
+{
+    int job_number;
+    int priority;
+    long long running_time;
+    long long start_time;
+    long long time;
+    int core;
+    int firsty; //1 = it has been seen before
+    long long response_time; //when it first got some time in a core
+    long long waiting_time;
+    long long when_preempted;
+    long long first_time;
+    long long arrival; //unlike time, never moved forward by RR
+    int level; //MLFQ: the queue of thing it waits in, 0 being the highest; otherwise always 0
+    long long slice; //how long it may run before its quantum expires, or -1 if there is no limit
+    int weight; //its share of the CPU, from its priority; see priority_weight()
+    long long vruntime; //CFS: time it has run, scaled by weight; its pass under STRIDE or LOTTERY
+    priqueue_handle_t handle; //where it sits in thing while it waits, or in victims while it runs
+    long long seq; //when it last joined the line, running or not; see job_seq()
+} job_t;
+
+/**
+ * PRI starts with one bucket for each priority below this. The first
+ * priority outside them moves its queue to the tree; see ready_widen().
+ */
+#define PRIORITY_BUCKETS 64
+
+long long key0   (const void * a);
+long long key1   (const void * a);
+long long key3   (const void * a);
+long long key7   (const void * a);
+int       bucket3(const void * a);
+
+#endif /* SCHEDULER_INTERNAL_H_ */
@@ -0,0 +1,234 @@
+/** @file libtrace.c
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libtrace.h"
+
+
+//Reads a decimal integer at p, after any blanks, and returns the first byte after it, or NULL if there are no digits.
+static const char *scan_integer(const char *p, const char *end, long long *value)
+{
+	unsigned long long v = 0;
+	int negative = 0;
+	const char *digits;
+
+	while(p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	if(p < end && (*p == '-' || *p == '+'))
+		negative = (*p++ == '-');
+	for(digits = p; p < end && (unsigned)(*p - '0') < 10; p++)
+		v = v * 10 + (unsigned)(*p - '0');
+
+	if(p == digits)
+		return NULL;
+	*value = negative ? -(long long)v : (long long)v;
+	return p;
+}
+
+
+//Skips the rest of a field; returns its separator, or end if there is none.
+static const char *skip_field(const char *p, const char *end)
+{
+	while(p < end && *p != ',' && *p != '\n')
+		p++;
+	return p;
+}
+
+
+/**
+  Maps a trace file into memory and counts its jobs. A file starting with
+  TRACE_MAGIC is a binary trace; any other is CSV, whose first line is a
+  header and whose every other line must be a job.
+
+  @param t a pointer to an instance of the trace_t data structure
+  @param file_name the trace to open
+  @return 0 on success, -1 if the file could not be read, or -2 if it is
+  a binary trace that does not match this build or is cut short
+ */
+int trace_open(trace_t *t, const char *file_name)
+{
+	struct stat st;
+	int fd = open(file_name, O_RDONLY);
+
+	t->map = NULL;
+	t->size = 0;
+	t->records = NULL;
+	t->count = t->read = 0;
+
+	if(fd == -1)
+		return -1;
+	if(fstat(fd, &st) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+
+	//An empty file has no jobs, and cannot be mapped.
+	t->size = (size_t) st.st_size;
+	if(t->size == 0)
+	{
+		close(fd);
+		return 0;
+	}
+
+	void *map = mmap(NULL, t->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+	{
+		t->size = 0;
+		return -1;
+	}
+	t->map = map;
+	madvise(map, t->size, MADV_SEQUENTIAL);
+
+	if(t->size >= sizeof(trace_header_t) && memcmp(t->map, TRACE_MAGIC, 8) == 0)
+	{
+		const trace_header_t *header = (const trace_header_t *) t->map;
+
+		if(header->version != TRACE_VERSION || header->record_size != sizeof(trace_record_t) ||
+				header->count > (t->size - sizeof(trace_header_t)) / sizeof(trace_record_t))
+		{
+			trace_close(t);
+			return -2;
+		}
+
+		t->records = (const trace_record_t *)(header + 1);
+		t->count = (long long) header->count;
+		return 0;
+	}
+
+	//Every line after the header is a row, the last one with or without its newline.
+	const char *end = t->map + t->size, *p;
+	t->next = memchr(t->map, '\n', t->size);
+	t->next = t->next ? t->next + 1 : end;
+
+	for(p = t->next; (p = memchr(p, '\n', (size_t)(end - p))) != NULL; p++)
+		t->count++;
+	if(t->next < end && end[-1] != '\n')
+		t->count++;
+
+	return 0;
+}
+
+
+/**
+  Returns the number of jobs in the trace, known as soon as it is opened.
+
+  @param t a pointer to an instance of the trace_t data structure
+  @return the number of jobs in the trace
+ */
+long long trace_count(trace_t *t)
+{
+	return t->count;
+}
+
+
+/**
+  Reads the next job of the trace. A binary record is read in place; a
+  CSV row is scanned without being copied, ignoring any columns after the
+  third. A job that could never finish is refused, as is a row whose
+  columns are not integers.
+
+  @param t a pointer to an instance of the trace_t data structure
+  @param arrival_time set to the arrival time of the job
+  @param run_time set to the running time of the job
+  @param priority set to the priority of the job
+  @return 1 if a job was read, 0 if there are no more, or -1 if the next
+  CSV row does not start with three integer columns, or the next job's
+  running time is not positive
+ */
+int trace_next(trace_t *t, long long *arrival_time, long long *run_time, int *priority)
+{
+	if(t->read == t->count)
+		return 0;
+
+	if(t->records)
+	{
+		const trace_record_t *record = &t->records[t->read++];
+		*arrival_time = record->arrival_time;
+		*run_time = record->run_time;
+		*priority = record->priority;
+		return *run_time > 0 ? 1 : -1;
+	}
+
+	const char *p = t->next, *end = t->map + t->size;
+	long long value;
+
+	if(!(p = scan_integer(p, end, arrival_time)) || (p = skip_field(p, end)) == end || *p++ != ',')
+		return -1;
+	if(!(p = scan_integer(p, end, run_time)) || (p = skip_field(p, end)) == end || *p++ != ',')
+		return -1;
+	if(!(p = scan_integer(p, end, &value)) || *run_time <= 0)
+		return -1;
+	*priority = (int) value;
+
+	p = memchr(p, '\n', (size_t)(end - p));
+	t->next = p ? p + 1 : end;
+	t->read++;
+	return 1;
+}
+
+
+/**
+  Unmaps the trace.
+
+  @param t a pointer to an instance of the trace_t data structure
+ */
+void trace_close(trace_t *t)
+{
+	if(t->map)
+		munmap((void *) t->map, t->size);
+	t->map = NULL;
+	t->size = 0;
+	t->records = NULL;
+	t->count = t->read = 0;
+}
+
+
+/**
+  Starts a binary trace of count jobs, each to be written with
+  trace_write_record().
+
+  @param file the stream to write to
+  @param count the number of records that will follow
+  @return 1 on success, 0 if the write failed
+ */
+int trace_write_header(FILE *file, long long count)
+{
+	trace_header_t header;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRACE_MAGIC, 8);
+	header.version = TRACE_VERSION;
+	header.record_size = sizeof(trace_record_t);
+	header.count = (uint64_t) count;
+
+	return fwrite(&header, sizeof(header), 1, file) == 1;
+}
+
+
+/**
+  Writes one job of a binary trace.
+
+  @param file the stream to write to
+  @param arrival_time the arrival time of the job
+  @param run_time the running time of the job
+  @param priority the priority of the job
+  @return 1 on success, 0 if the write failed
+ */
+int trace_write_record(FILE *file, long long arrival_time, long long run_time, int priority)
+{
+	trace_record_t record;
+
+	record.arrival_time = arrival_time;
+	record.run_time = run_time;
+	record.priority = priority;
+	record.reserved = 0;
+
+	return fwrite(&record, sizeof(record), 1, file) == 1;
+}
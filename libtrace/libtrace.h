@@ -0,0 +1,69 @@
+/** @file libtrace.h
+ */
+
+#ifndef LIBTRACE_H_
+#define LIBTRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+  The first bytes of a binary trace; anything else is read as CSV.
+*/
+#define TRACE_MAGIC "SCHTRACE"
+#define TRACE_VERSION 1
+
+/**
+  Binary Trace Header
+
+  Starts a binary trace and is followed directly by count records. All
+  fields are in the byte order of the machine that wrote them.
+*/
+typedef struct _trace_header_t
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size; //sizeof(trace_record_t) when written
+	uint64_t count;
+} trace_header_t;
+
+/**
+  Binary Trace Record
+
+  One job, fixed width, so a mapped trace is read in place.
+*/
+typedef struct _trace_record_t
+{
+	int64_t arrival_time;
+	int64_t run_time;
+	int32_t priority;
+	int32_t reserved; //written as 0
+} trace_record_t;
+
+/**
+  Trace Data Structure
+
+  A trace file mapped into memory, either a CSV file with a header line
+  and one "arrival time,run time,priority" row per job, or a binary
+  trace. The jobs are read one at a time with trace_next().
+*/
+typedef struct _trace_t
+{
+	const char *map;
+	size_t size;
+	const trace_record_t *records; //NULL for CSV
+	const char *next; //start of the next CSV row
+	long long count;
+	long long read;
+} trace_t;
+
+int       trace_open (trace_t *t, const char *file_name);
+long long trace_count(trace_t *t);
+int       trace_next (trace_t *t, long long *arrival_time, long long *run_time, int *priority);
+void      trace_close(trace_t *t);
+
+int       trace_write_header(FILE *file, long long count);
+int       trace_write_record(FILE *file, long long arrival_time, long long run_time, int priority);
+
+#endif /* LIBTRACE_H_ */
@@ -1,6 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include "libpriqueue/libpriqueue.h"
+#include "libpool/libpool.h"
+#include "libmultiqueue/libmultiqueue.h"
+#include "libhistogram/libhistogram.h"
 int compare1(const void * a, const void * b)
 {
     return ( *(int*)a - *(int*)b );
@@ -9,6 +13,42 @@ int compare2(const void * a, const void * b)
 {
     return ( *(int*)b - *(int*)a );
 }
+int bucket1(const void * a)
+{
+    return *(int*)a;
+}
+int bucket10(const void * a)
+{
+    return *(int*)a / 10;
+}
+long long tens(const void * a)
+{
+    return *(int*)a / 10;
+}
+long long units_down(const void * a)
+{
+    return 9 - *(int*)a % 10;
+}
+#define MQ_THREADS 4
+#define MQ_ITEMS 20000
+multiqueue_t mq;
+int mq_items[MQ_ITEMS];
+int mq_polled[MQ_ITEMS];
+void *mq_work(void * arg)
+{
+    int first = *(int*)arg, i;
+    int *item;
+    for(i = first; i < MQ_ITEMS; i += MQ_THREADS)
+        multiqueue_offer(&mq, &mq_items[i]);
+    while((item = multiqueue_poll(&mq)) != NULL)
+        __atomic_add_fetch(&mq_polled[item - mq_items], 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+int compare_ll(const void * a, const void * b)
+{
+    long long x = *(long long*)a, y = *(long long*)b;
+    return (x > y) - (x < y);
+}
 int main() {
     priqueue_t q; 
     priqueue_init(&q, compare1);
@@ -158,6 +198,256 @@ int main() {
         printf("properly removed a single value from the queue\n");
     else printf("did not properly remove value when it's the only one in the queue\n");
      priqueue_destroy(&q);
+
+    printf("\n");
+    priqueue_init_kind(&q, compare1, PRIQUEUE_HEAP);
+    for(i = 9; i >= 5; i--)
+        priqueue_offer(&q, &values[i]);
+    for(i = 0; i < 5; i++)
+        priqueue_offer(&q, &values[i]);
+    printf("printing heap-backed queue, should be in order from 0-9\n");
+    for (i = 0; i < priqueue_size(&q); i++)
+        printf("%d ", *((int *)priqueue_at(&q, i)) );
+    printf("\n");
+
+    printf("polling heap-backed queue, should be in order from 0-9\n");
+    while(priqueue_size(&q))
+        printf("%d ", *((int *)priqueue_poll(&q)) );
+    printf("\n");
+    priqueue_destroy(&q);
+
+    priqueue_init_kind(&q, compare1, PRIQUEUE_HEAP);
+    printf("offering 5, 7, 3 to a heap-backed queue, should return 0 -1 0\n");
+    printf("%d ", priqueue_offer(&q, &values[5]));
+    printf("%d ", priqueue_offer(&q, &values[7]));
+    printf("%d ", priqueue_offer(&q, &values[3]));
+    printf("\n");
+    priqueue_destroy(&q);
+
+    printf("\n");
+    void *batch[10];
+    for(i = 0; i < 10; i++)
+        batch[i] = &values[9 - i];
+    priqueue_init(&q, compare1);
+    priqueue_build(&q, batch, 10);
+    printf("printing queue built in one batch, should be in order from 0-9\n");
+    for (i = 0; i < priqueue_size(&q); i++)
+        printf("%d ", *((int *)priqueue_at(&q, i)) );
+    printf("\n");
+
+    printf("polling batches of 4, should be 0-3, 4-7 and 8-9\n");
+    int polled;
+    while((polled = priqueue_poll_batch(&q, batch, 4)) > 0) {
+        for(i = 0; i < polled; i++)
+            printf("%d ", *((int *)batch[i]) );
+        printf("| ");
+    }
+    printf("\n");
+    priqueue_destroy(&q);
+
+    printf("\n");
+    const char *kinds[] = {"tree", "heap", "FIFO", "bucket"};
+    int keys[10];
+    priqueue_handle_t handles[10];
+    int k;
+    for(k = PRIQUEUE_TREE; k <= PRIQUEUE_BUCKET; k++) {
+        if(k == PRIQUEUE_BUCKET)
+            priqueue_init_bucket(&q, compare1, bucket1, 16);
+        else
+            priqueue_init_kind(&q, compare1, k);
+        for(i = 0; i < 10; i++) {
+            keys[i] = i;
+            handles[i] = priqueue_offer_handle(&q, &keys[i]);
+        }
+
+        priqueue_remove_handle(&q, handles[0]);
+        priqueue_remove_handle(&q, handles[5]);
+        priqueue_remove_handle(&q, handles[9]);
+        printf("removing the head, middle and tail of a %s-backed queue by handle, should be 1 2 3 4 6 7 8\n", kinds[k]);
+        for (i = 0; i < priqueue_size(&q); i++)
+            printf("%d ", *((int *)priqueue_at(&q, i)) );
+        printf("\n");
+
+        keys[1] = 10;
+        priqueue_update_key(&q, handles[1]);
+        keys[6] = 0;
+        priqueue_update_key(&q, handles[6]);
+        keys[1] = 5;
+        priqueue_update_key(&q, handles[1]);
+        if(k == PRIQUEUE_FIFO)
+            printf("re-keying the head, middle and tail, should be 2 3 4 7 8 0 5\n");
+        else
+            printf("re-keying the head, middle and tail, should be 0 2 3 4 5 7 8\n");
+        while(priqueue_size(&q))
+            printf("%d ", *((int *)priqueue_poll(&q)) );
+        printf("\n");
+        priqueue_destroy(&q);
+    }
+
+    printf("\n");
+    pool_t pool;
+    pool_chunk_t *chunk;
+    int *slots[7], chunks, reused;
+    pool_init(&pool, sizeof(int), 2);
+    for(i = 0; i < 7; i++) {
+        slots[i] = pool_alloc(&pool);
+        *slots[i] = i;
+    }
+    for(chunks = 0, chunk = pool.chunks; chunk; chunk = chunk->next)
+        chunks++;
+    printf("allocating 7 slots from a pool whose first chunk holds 2, chunks used: %d (should be 3)\n", chunks);
+    for(i = 0, j = 0; i < 7; i++)
+        j += *slots[i] == i;
+    printf("slots holding their own value: %d (should be 7)\n", j);
+
+    for(i = 6; i >= 0; i -= 2)
+        pool_free(&pool, slots[i]);
+    for(i = 5; i >= 0; i -= 2)
+        pool_free(&pool, slots[i]);
+    for(i = 0, reused = 0; i < 7; i++) {
+        int *slot = pool_alloc(&pool);
+        for(j = 0; j < 7; j++)
+            reused += slot == slots[j];
+    }
+    for(chunks = 0, chunk = pool.chunks; chunk; chunk = chunk->next)
+        chunks++;
+    printf("freeing all 7 across the chunks and allocating 7 again, slots reused: %d (should be 7), chunks: %d (should be 3)\n", reused, chunks);
+    pool_destroy(&pool);
+
+    printf("\n");
+    int fifo_order[] = {5, 3, 8, 1, 9, 2, 7};
+    priqueue_init_kind(&q, compare1, PRIQUEUE_FIFO);
+    for(i = 0; i < 7; i++)
+        priqueue_offer(&q, &values[fifo_order[i]]);
+    printf("printing FIFO-backed queue, should be 5 3 8 1 9 2 7\n");
+    for (i = 0; i < priqueue_size(&q); i++)
+        printf("%d ", *((int *)priqueue_at(&q, i)) );
+    printf("\n");
+
+    printf("printing it backwards, should be 7 2 9 1 8 3 5\n");
+    for (i = priqueue_size(&q) - 1; i >= 0; i--)
+        printf("%d ", *((int *)priqueue_at(&q, i)) );
+    printf("\n");
+
+    printf("at(3), poll, at(2), at(3), should be 1 5 1 9\n");
+    printf("%d ", *((int *)priqueue_at(&q, 3)) );
+    printf("%d ", *((int *)priqueue_poll(&q)) );
+    printf("%d ", *((int *)priqueue_at(&q, 2)) );
+    printf("%d ", *((int *)priqueue_at(&q, 3)) );
+    printf("\n");
+
+    priqueue_remove_at(&q, 1);
+    printf("removing index 1, should be 3 1 9 2 7\n");
+    for (i = 0; i < priqueue_size(&q); i++)
+        printf("%d ", *((int *)priqueue_at(&q, i)) );
+    printf("\n");
+    priqueue_destroy(&q);
+
+    printf("\n");
+    int bucket_order[] = {5, 2, 9, 2, 0, 12, 7};
+    priqueue_init_bucket(&q, compare1, bucket1, 8);
+    printf("offering 5 2 9 2 0 12 7 to a bucket-backed queue with 8 buckets, ranks should be 0 0 2 1 0 5 4\n");
+    for(i = 0; i < 7; i++)
+        printf("%d ", priqueue_offer(&q, &values[bucket_order[i]]) );
+    printf("\n");
+
+    printf("printing it, should be 0 2 2 5 7 9 12\n");
+    for (i = 0; i < priqueue_size(&q); i++)
+        printf("%d ", *((int *)priqueue_at(&q, i)) );
+    printf("\n");
+
+    printf("at(4), at(1), at(6), at(5), should be 7 2 12 9\n");
+    printf("%d ", *((int *)priqueue_at(&q, 4)) );
+    printf("%d ", *((int *)priqueue_at(&q, 1)) );
+    printf("%d ", *((int *)priqueue_at(&q, 6)) );
+    printf("%d ", *((int *)priqueue_at(&q, 5)) );
+    printf("\n");
+
+    printf("removing index 3, should be 5, leaving 0 2 2 7 9 12\n");
+    printf("%d\n", *((int *)priqueue_remove_at(&q, 3)) );
+    for (i = 0; i < priqueue_size(&q); i++)
+        printf("%d ", *((int *)priqueue_at(&q, i)) );
+    printf("\n");
+    priqueue_destroy(&q);
+
+    printf("\n");
+    int keyed_order[] = {21, 13, 25, 11, 16};
+    const char *modes[] = {"the comparer", "set_key(tens)", "set_keys(tens, units descending)"};
+    const char *keyed_expected[] = {"11 13 16 21 25", "13 11 16 21 25", "16 13 11 25 21"};
+    int mode;
+    for(k = PRIQUEUE_TREE; k <= PRIQUEUE_BUCKET; k++)
+        for(mode = 0; mode < 3; mode++) {
+            if(k == PRIQUEUE_BUCKET)
+                priqueue_init_bucket(&q, compare1, bucket10, 4);
+            else
+                priqueue_init_kind(&q, compare1, k);
+            if(mode == 1)
+                priqueue_set_key(&q, tens);
+            else if(mode == 2)
+                priqueue_set_keys(&q, tens, units_down);
+
+            for(i = 0; i < 5; i++)
+                priqueue_offer(&q, &values[keyed_order[i]]);
+            printf("polling a %s-backed queue ordered by %s, should be %s\n", kinds[k], modes[mode],
+                k == PRIQUEUE_FIFO ? "21 13 25 11 16" : keyed_expected[mode]);
+            while(priqueue_size(&q))
+                printf("%d ", *((int *)priqueue_poll(&q)) );
+            printf("\n");
+            priqueue_destroy(&q);
+        }
+
+    printf("\n");
+    pthread_t threads[MQ_THREADS];
+    int firsts[MQ_THREADS];
+    int *item;
+    multiqueue_init(&mq, compare1, 2 * MQ_THREADS);
+    for(i = 0; i < MQ_ITEMS; i++)
+        mq_items[i] = i % 100;
+    for(i = 0; i < MQ_THREADS; i++) {
+        firsts[i] = i;
+        pthread_create(&threads[i], NULL, mq_work, &firsts[i]);
+    }
+    for(i = 0; i < MQ_THREADS; i++)
+        pthread_join(threads[i], NULL);
+    //A thread may find the queue empty while another is still offering.
+    while((item = multiqueue_poll(&mq)) != NULL)
+        mq_polled[item - mq_items]++;
+    for(i = 0, j = 0; i < MQ_ITEMS; i++)
+        j += mq_polled[i] == 1;
+    printf("%d threads offering and polling %d elements of a multiqueue, polled exactly once: %d (should be %d), left: %d (should be 0)\n",
+        MQ_THREADS, MQ_ITEMS, j, MQ_ITEMS, multiqueue_size(&mq));
+    multiqueue_destroy(&mq);
+
+    printf("\n");
+    static histogram_t histogram;
+    static long long samples[100000];
+    const double percentiles[] = {0, 1, 10, 25, 50, 90, 99, 99.9, 100};
+    const char *distributions[] = {"uniform 1-100000", "squares 1-100000^2", "90% below 100, 10% above 10^9"};
+    int d, p, within;
+    for(d = 0; d < 3; d++) {
+        histogram_init(&histogram);
+        for(i = 0; i < 100000; i++) {
+            if(d == 0)
+                samples[i] = i + 1;
+            else if(d == 1)
+                samples[i] = (long long)(i + 1) * (i + 1);
+            else
+                samples[i] = i % 10 ? i % 100 : 1000000000LL + i * 7919LL;
+            histogram_record(&histogram, samples[i]);
+        }
+        qsort(samples, 100000, sizeof(long long), compare_ll);
+
+        for(p = 0, within = 0; p < 9; p++) {
+            double at = percentiles[p] / 100 * 100000;
+            int rank = (int) at < at ? (int) at + 1 : (int) at;
+            long long exact = samples[rank > 0 ? rank - 1 : 0];
+            long long read = histogram_percentile(&histogram, percentiles[p]);
+            within += read >= exact && read - exact <= exact / 64;
+        }
+        printf("%s: percentiles within 1/64 above the exact value: %d (should be 9), count: %lld, max: %lld\n",
+            distributions[d], within, histogram_count(&histogram), histogram_max(&histogram));
+    }
+
     free(values);
     return 0;
 
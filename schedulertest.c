@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libscheduler/libscheduler.h"
+
+typedef struct {
+    long long arrival, run_time;
+    int priority;
+} test_job_t;
+
+/*
+ * Runs the jobs on core 0 of s from time 0 up to end, in the order the
+ * simulator does things: finished jobs, then expired quanta, then
+ * arrivals, then one time unit. ran[i] is set to how long job i got the
+ * core. If dispatches is not NULL, each job given the core is appended to
+ * it as its letter and its quantum, e.g. "A1 B2 ".
+ */
+void run(scheduler_t *s, const test_job_t *jobs, int n, long long end, long long *ran, char *dispatches)
+{
+    long long t, left[16], clock = -1;
+    int i, running = -1, next;
+
+    for(i = 0; i < n; i++) {
+        left[i] = jobs[i].run_time;
+        ran[i] = 0;
+    }
+    if(dispatches)
+        dispatches[0] = '\0';
+
+    for(t = 0; t < end; t++) {
+        next = -2;
+        if(running != -1 && left[running] == 0)
+            next = scheduler_job_finished_r(s, 0, running, t);
+        else if(running != -1 && clock == 0)
+            next = scheduler_quantum_expired_r(s, 0, t);
+        for(i = 0; i < n; i++)
+            if(jobs[i].arrival == t && scheduler_new_job_r(s, i, t, jobs[i].run_time, jobs[i].priority) == 0)
+                next = i;
+
+        if(next != -2) {
+            running = next;
+            clock = scheduler_quantum_r(s, 0);
+            if(dispatches && running != -1)
+                sprintf(dispatches + strlen(dispatches), "%c%lld ", 'A' + running, clock);
+        }
+
+        if(running != -1) {
+            left[running]--;
+            ran[running]++;
+            if(clock > 0)
+                clock--;
+        }
+    }
+}
+
+int main() {
+    scheduler_t *s;
+    long long ran[16];
+    char dispatches[256];
+    const long long mlfq_quanta[] = {1, 2, 4};
+
+    test_job_t two_long[] = {{0, 100, 0}, {0, 100, 0}};
+    s = scheduler_create(1, MLFQ);
+    scheduler_set_mlfq_r(s, 3, mlfq_quanta, 0);
+    run(s, two_long, 2, 14, ran, dispatches);
+    printf("MLFQ with quanta 1 2 4 and no boost, two long jobs, should be A1 B1 A2 B2 A4 B4\n");
+    printf("%s\n", dispatches);
+    scheduler_destroy(s);
+
+    s = scheduler_create(1, MLFQ);
+    scheduler_set_mlfq_r(s, 3, mlfq_quanta, 8);
+    run(s, two_long, 2, 14, ran, dispatches);
+    printf("the same with a boost every 8, B back on top at time 10, should be A1 B1 A2 B2 A4 B1 B2 A4\n");
+    printf("%s\n", dispatches);
+    scheduler_destroy(s);
+
+    test_job_t weighted[] = {{0, 1000000, 0}, {0, 1000000, 5}};
+    s = scheduler_create(1, CFS);
+    scheduler_set_quantum_r(s, 1);
+    run(s, weighted, 2, 30000, ran, NULL);
+    printf("CFS with priorities 0 and 5 (weights 1024 and 335), runtime ratio should be 3.06 within 1%%\n");
+    printf("%.2f %s\n", (double) ran[0] / ran[1],
+        ran[0] * 335 < ran[1] * 1024 * 1.01 && ran[0] * 335 > ran[1] * 1024 * 0.99 ? "ok" : "NOT within 1%");
+    scheduler_destroy(s);
+
+    test_job_t tickets[] = {{0, 1000000, 0}, {0, 1000000, 5}, {0, 1000000, 10}};
+    const int weights[] = {1024, 335, 110};
+    int i, proportional = 0;
+    s = scheduler_create(1, STRIDE);
+    scheduler_set_quantum_r(s, 1);
+    run(s, tickets, 3, 30000, ran, NULL);
+    printf("STRIDE with priorities 0, 5 and 10 (1024, 335 and 110 tickets), shares within 1%% of the tickets: should be 3\n");
+    for(i = 0; i < 3; i++) {
+        double share = ran[i] / 30000.0, expected = weights[i] / 1469.0;
+        proportional += share < expected * 1.01 && share > expected * 0.99;
+    }
+    printf("%d (%lld %lld %lld)\n", proportional, ran[0], ran[1], ran[2]);
+    scheduler_destroy(s);
+
+    return 0;
+}
@@ -7,56 +7,131 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
-#include <assert.h>
+#include <limits.h>
 
 #include "libscheduler/libscheduler.h"
+#include "libpriqueue/libpriqueue.h"
+#include "libtrace/libtrace.h"
 
 
 typedef struct _simulator_job_list_t
 {
-	int job_id, arrival_time, run_time, priority;
+	int job_id, priority;
+	long long arrival_time, run_time;
 	int core_id, arrived;
+	int slot; //where it is in order[], or -1 once finished; see remove_job()
 } simulator_job_list_t;
 
+/*
+ * A stretch of time one core spent on one job, or idle if job_id is -1.
+ */
+typedef struct _segment_t
+{
+	int job_id;
+	long long start, length;
+} segment_t;
+
+/*
+ * What one core did, as segments in time order. Recording a time unit is
+ * O(1) and memory grows with the number of changes rather than with
+ * time; the text of the timing diagram is only made as it is printed.
+ */
+typedef struct _timeline_t
+{
+	segment_t *segments;
+	int count, capacity;
+} timeline_t;
+
+/*
+ * How much the simulator prints: with -q just the summary at the end,
+ * and its final timing diagram only if -w asks for one, with -v every
+ * event as well, and by default a frame after every time unit too.
+ */
+typedef enum { SUMMARY = 0, EVENTS, FRAMES } verbosity_t;
+
+/*
+ * Output goes through a buffer this big, flushed as it fills rather
+ * than at every line, since a full trace can run to gigabytes.
+ */
+#define OUTPUT_BUFFER (1 << 20)
+static char output_buffer[OUTPUT_BUFFER];
+
 void print_usage(char *program_name)
 {
-	fprintf(stderr, "Usage: %s -c <cores> -s <scheme> <input file>\n", program_name);
+	fprintf(stderr, "Usage: %s -c <cores> -s <scheme> [-b <boost>] [-e] [-w <start>:<end>] [-q | -v] [-o <output file>] <input file>\n", program_name);
 	fprintf(stderr, "       %s -c 2 -s fcfs examples/proc1.csv\n", program_name);
 	fprintf(stderr, "\n");
-	fprintf(stderr, "Acceptable schemes are: fcfs, sjf, psjf, pri, ppri, rr#\n");
+	fprintf(stderr, "Acceptable schemes are: fcfs, sjf, psjf, pri, ppri, rr#, mlfq#, cfs#, stride#, lottery#\n");
+	fprintf(stderr, "mlfq# has # levels (default 3) with quanta 1, 2, 4, ... and moves\n");
+	fprintf(stderr, "waiting jobs back to the top level every <boost> time units (default %d, 0 = never).\n", MLFQ_BOOST);
+	fprintf(stderr, "cfs# has a minimum granularity of # (default 1); stride# and lottery# a quantum of # (default 1).\n");
+	fprintf(stderr, "-e skips from one event to the next instead of printing every time unit.\n");
+	fprintf(stderr, "-w only draws time units <start> up to <end> of the timing diagrams; either may be left out.\n");
+	fprintf(stderr, "-q only prints the summary at the end, without the timing diagram unless -w is given; -v also prints each event, but not a frame for every time unit.\n");
+	fprintf(stderr, "-o writes the output to <output file> instead of the terminal.\n");
+	fprintf(stderr, "<input file> is a CSV file or a binary trace made from one by tracecvt.\n");
 }
 
-int set_active_job(int job_id, int core_id, simulator_job_list_t *jobs, int active_jobs)
+int set_active_job(int job_id, int core_id, simulator_job_list_t *jobs, int job_count, int *running)
 {
-	int i;
-	for (i = 0; i < active_jobs; i++)
-	{
-		if (jobs[i].job_id == job_id && jobs[i].arrived)
-		{
-			jobs[i].core_id = core_id;
-			return 1;
-		}
-	}
+	if (job_id < 0 || job_id >= job_count || !jobs[job_id].arrived || jobs[job_id].slot == -1)
+		return 0;
+
+	// Whoever was on the core stops, as does the job wherever it was
+	if (running[core_id] != -1)
+		jobs[running[core_id]].core_id = -1;
+	if (jobs[job_id].core_id != -1)
+		running[jobs[job_id].core_id] = -1;
+
+	jobs[job_id].core_id = core_id;
+	running[core_id] = job_id;
+	return 1;
+}
 
-	return 0;
+/*
+ * Takes a finished job out of order[] by moving the last job into its
+ * slot. Jobs finishing or arriving in the same time unit are handled in
+ * the order they hold there, which this keeps the same as when the jobs
+ * themselves were moved.
+ */
+void remove_job(simulator_job_list_t *job, simulator_job_list_t *jobs, int *order, int active_jobs)
+{
+	int last = order[active_jobs - 1];
+
+	order[job->slot] = last;
+	jobs[last].slot = job->slot;
+	job->slot = -1;
 }
 
-void print_available_jobs(simulator_job_list_t *jobs, int active_jobs)
+//Orders jobs by arrival time, for the arrival cursor.
+int compare_arrival(const void *a, const void *b)
+{
+	const simulator_job_list_t *ja = *(simulator_job_list_t * const *)a;
+	const simulator_job_list_t *jb = *(simulator_job_list_t * const *)b;
+
+	if (ja->arrival_time != jb->arrival_time)
+		return ja->arrival_time < jb->arrival_time ? -1 : 1;
+	return ja->job_id - jb->job_id;
+}
+
+void print_available_jobs(simulator_job_list_t *jobs, int *order, int active_jobs)
 {
 	printf("Active jobs are: ");
 
 	int i, first = 1;
 	for (i = 0; i < active_jobs; i++)
 	{
-		if (jobs[i].arrived)
+		simulator_job_list_t *job = &jobs[order[i]];
+
+		if (job->arrived)
 		{
 			if (first)
 			{
-				printf("%d", jobs[i].job_id);
+				printf("%d", job->job_id);
 				first = 0;
 			}
 			else
-				printf(", %d", jobs[i].job_id);
+				printf(", %d", job->job_id);
 		}
 	}
 
@@ -64,6 +139,139 @@ void print_available_jobs(simulator_job_list_t *jobs, int active_jobs)
 		printf("\n");
 }
 
+void print_percentiles(const char *name, long long (*percentile)(double))
+{
+	printf("  %-16s %7lld %7lld %7lld %7lld %7lld\n", name,
+		percentile(50), percentile(90), percentile(99), percentile(99.9), percentile(100));
+}
+
+/*
+ * The quantum of the job just given core_id. RR's is the same for every
+ * job; the other schemes say how long each job may run, if they limit it.
+ */
+long long next_quantum(int scheme, int quantum, int core_id)
+{
+	if (scheme == RR)
+		return quantum;
+
+	return scheduler_quantum(core_id);
+}
+
+/*
+ * Records that a core spent the next length time units on job_id, or
+ * idle if it is -1. Returns 0 if out of memory.
+ */
+int timeline_add(timeline_t *timeline, int job_id, long long length)
+{
+	segment_t *last = timeline->count ? &timeline->segments[timeline->count - 1] : NULL;
+
+	if (last && last->job_id == job_id)
+	{
+		last->length += length;
+		return 1;
+	}
+
+	long long start = last ? last->start + last->length : 0;
+
+	if (timeline->count == timeline->capacity)
+	{
+		timeline->capacity = timeline->capacity ? timeline->capacity * 2 : 16;
+		timeline->segments = realloc(timeline->segments, timeline->capacity * sizeof(segment_t));
+
+		if (timeline->segments == NULL)
+			return 0;
+	}
+
+	segment_t *next = &timeline->segments[timeline->count++];
+	next->job_id = job_id;
+	next->start = start;
+	next->length = length;
+	return 1;
+}
+
+/*
+ * Prints the timing diagram of a core from time unit from up to, but not
+ * including, to: each unit as the job that ran, or '-' if none did.
+ */
+void timeline_print(timeline_t *timeline, long long from, long long to)
+{
+	int low = 0, high = timeline->count, i;
+	long long k;
+
+	// The first segment that ends after from
+	while (low < high)
+	{
+		int middle = low + (high - low) / 2;
+		segment_t *segment = &timeline->segments[middle];
+
+		if (segment->start + segment->length <= from)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	for (i = low; i < timeline->count && timeline->segments[i].start < to; i++)
+	{
+		segment_t *segment = &timeline->segments[i];
+		char label[16];
+		int job_id = segment->job_id;
+
+		if (job_id == -1)
+			strcpy(label, "-");
+		else if (job_id < 10)
+			sprintf(label, "%d", job_id);
+		else if (job_id < 10 + 26)
+			sprintf(label, "%c", job_id - 10 + 'a');
+		else if (job_id < 10 + 26 + 26)
+			sprintf(label, "%c", job_id - 10 - 26 + 'A');
+		else
+			sprintf(label, "(%d)", job_id);
+
+		long long first = segment->start > from ? segment->start : from;
+		long long last = segment->start + segment->length < to ? segment->start + segment->length : to;
+
+		for (k = first; k < last; k++)
+			fputs(label, stdout);
+	}
+}
+
+/*
+ * Prints the header of a time unit, unless it already has been: every
+ * unit gets one when frames are printed, but with -v only the units
+ * where something happens do.
+ */
+void print_time(long long time, long long *printed_time)
+{
+	if (*printed_time != time)
+	{
+		printf("=== [TIME %lld] ===\n", time);
+		*printed_time = time;
+	}
+}
+
+/*
+ * The key of the event heap, whose elements each point at the time of
+ * an event.
+ */
+long long event_time(const void *event)
+{
+	return *(const long long *)event;
+}
+
+/*
+ * Notes that the job or quantum on core_id changed, so with -e its next
+ * event is worked out again before time skips ahead. A core left alone
+ * keeps the same event time, so only these ones touch the heap.
+ */
+void touch_core(int core_id, int *touched, int *num_touched, char *is_touched)
+{
+	if (touched != NULL && !is_touched[core_id])
+	{
+		is_touched[core_id] = 1;
+		touched[(*num_touched)++] = core_id;
+	}
+}
+
 void print_available_cores(int cores)
 {
 	printf("Active cores are: ");
@@ -82,13 +290,15 @@ void print_available_cores(int cores)
 int main(int argc, char **argv)
 {
 	int c;
-	int cores = 0, scheme = -1, quantum = 0;
-	char *file_name;
+	int cores = 0, scheme = -1, quantum = 0, levels = 3, events_only = 0, window_given = 0;
+	long long boost = MLFQ_BOOST, window_start = 0, window_end = LLONG_MAX;
+	verbosity_t verbosity = FRAMES;
+	char *file_name, *output_name = NULL;
 
 	/*
 	 * Parse command line options.
 	 */
-	while ((c = getopt(argc, argv, "c:s:")) != -1)
+	while ((c = getopt(argc, argv, "c:s:b:ew:qvo:")) != -1)
 	{
 		switch (c)
 		{
@@ -121,6 +331,97 @@ int main(int argc, char **argv)
 						return 1;
 					}
 				}
+				else if (strncasecmp(optarg, "MLFQ", 4) == 0)
+				{
+					scheme = MLFQ;
+					if (optarg[4] != '\0')
+						levels = atoi(optarg + 4);
+
+					if (levels <= 0 || levels > 32)
+					{
+						fprintf(stderr, "Option -s <scheme> requires from 1 to 32 levels for MLFQ. (Eg: -s MLFQ3)\n");
+						print_usage(argv[0]);
+						return 1;
+					}
+				}
+				else if (strncasecmp(optarg, "CFS", 3) == 0)
+				{
+					scheme = CFS;
+					quantum = optarg[3] != '\0' ? atoi(optarg + 3) : 1;
+
+					if (quantum <= 0)
+					{
+						fprintf(stderr, "Option -s <scheme> requires a positive minimum granularity for CFS. (Eg: -s CFS2)\n");
+						print_usage(argv[0]);
+						return 1;
+					}
+				}
+				else if (strncasecmp(optarg, "STRIDE", 6) == 0 || strncasecmp(optarg, "LOTTERY", 7) == 0)
+				{
+					scheme = strncasecmp(optarg, "STRIDE", 6) == 0 ? STRIDE : LOTTERY;
+					char *n = optarg + (scheme == STRIDE ? 6 : 7);
+					quantum = *n != '\0' ? atoi(n) : 1;
+
+					if (quantum <= 0)
+					{
+						fprintf(stderr, "Option -s <scheme> requires a positive number for the quantum of STRIDE or LOTTERY. (Eg: -s STRIDE2)\n");
+						print_usage(argv[0]);
+						return 1;
+					}
+				}
+				break;
+
+			case 'b':
+				boost = atoll(optarg);
+
+				if (boost < 0)
+				{
+					fprintf(stderr, "Option -b <boost> requires a non-negative number.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'e':
+				events_only = 1;
+				break;
+
+			case 'w':
+			{
+				char *end = strchr(optarg, ':');
+
+				if (end == NULL)
+				{
+					fprintf(stderr, "Option -w <start>:<end> requires a ':'. (Eg: -w 100:200)\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+
+				window_given = 1;
+				if (end != optarg)
+					window_start = atoll(optarg);
+				if (end[1] != '\0')
+					window_end = atoll(end + 1);
+
+				if (window_start < 0 || window_end < window_start)
+				{
+					fprintf(stderr, "Option -w <start>:<end> requires 0 <= start <= end.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			}
+
+			case 'q':
+				verbosity = SUMMARY;
+				break;
+
+			case 'v':
+				verbosity = EVENTS;
+				break;
+
+			case 'o':
+				output_name = optarg;
 				break;
 
 			case '?':
@@ -157,61 +458,65 @@ int main(int argc, char **argv)
 	}
 
 
+	if (output_name != NULL && freopen(output_name, "w", stdout) == NULL)
+	{
+		fprintf(stderr, "Unable to open file \"%s\".\n", output_name);
+		return 2;
+	}
+
+	// The scheduler prints its queue to stdout too, so it shares the buffer
+	setvbuf(stdout, output_buffer, _IOFBF, OUTPUT_BUFFER);
+
+
 	/*
 	 * Open the file, read the file, and populate the jobs data structure.
+	 * The file, CSV or binary (see tracecvt), is mapped rather than read,
+	 * and its jobs are counted first so jobs is allocated only once.
 	 */
-	FILE *file = fopen(file_name, "r");
-	if (file == NULL)
+	trace_t trace;
+	int result = trace_open(&trace, file_name);
+	if (result == -1)
 	{
 		fprintf(stderr, "Unable to open file \"%s\".\n", file_name);
 		return 2;
 	}
+	else if (result == -2 || trace_count(&trace) >= INT_MAX)
+	{
+		fprintf(stderr, "Illegal file format.\n");
+		trace_close(&trace);
+		return 2;
+	}
 
 
 	int job_id = 0;
-	int jobs_ct = 10;
-	simulator_job_list_t* jobs = malloc(jobs_ct * sizeof(simulator_job_list_t));
+	simulator_job_list_t* jobs = malloc((trace_count(&trace) + 1) * sizeof(simulator_job_list_t));
 
-	char line[1024 + 1];
-	fgets(line, 1024, file);  // Ignore the first (header) line
-	while (fgets(line, 1024, file) != NULL)
+	if (!jobs)
 	{
-		char *arrival_time = strtok(line, ",");
-		char *run_time = strtok(NULL, ",");
-		char *priority = strtok(NULL, ",");
+		fprintf(stderr, "Out of memory.\n");
+		trace_close(&trace);
+		return 2;
+	}
 
-		if (arrival_time != NULL && run_time != NULL && priority != NULL)
-		{
-			if (job_id == jobs_ct)
-			{
-				jobs_ct *= 2;
-				jobs = realloc(jobs, jobs_ct * sizeof(simulator_job_list_t));
+	while ((result = trace_next(&trace, &jobs[job_id].arrival_time, &jobs[job_id].run_time, &jobs[job_id].priority)) == 1)
+	{
+		jobs[job_id].job_id = job_id;
+		jobs[job_id].core_id = -1;
+		jobs[job_id].arrived = 0;
+		jobs[job_id].slot = job_id;
 
-				if (!jobs)
-				{
-					fprintf(stderr, "Out of memory.\n");
-					return 2;
-				}
-			}
+		job_id++;
+	}
 
-			jobs[job_id].job_id = job_id;
-			jobs[job_id].arrival_time = atoi(arrival_time);
-			jobs[job_id].run_time = atoi(run_time);
-			jobs[job_id].priority = atoi(priority);
-			jobs[job_id].core_id = -1;
-			jobs[job_id].arrived = 0;
+	trace_close(&trace);
 
-			job_id++;
-		}
-		else
-		{
-			fprintf(stderr, "Illegal file format.\n");
-			return 2;
-		}
+	if (result == -1)
+	{
+		fprintf(stderr, "Illegal file format.\n");
+		free(jobs);
+		return 2;
 	}
 
-	fclose(file);
-
 
 	/*
 	 * Run the simulation.
@@ -224,63 +529,146 @@ int main(int argc, char **argv)
 	else if (scheme == PRI) { printf("Non-preemptive Priority (PRI)"); }
 	else if (scheme == PPRI) { printf("Preemptive Priority (PPRI)"); }
 	else if (scheme == RR) { printf("Round Robin (RR) with a quantum of %d", quantum); }
+	else if (scheme == MLFQ) { printf("Multilevel Feedback Queue (MLFQ) with %d level(s) and a boost every %lld", levels, boost); }
+	else if (scheme == CFS) { printf("Completely Fair Scheduler (CFS) with a minimum granularity of %d", quantum); }
+	else if (scheme == STRIDE) { printf("Stride Scheduling (STRIDE) with a quantum of %d", quantum); }
+	else if (scheme == LOTTERY) { printf("Lottery Scheduling (LOTTERY) with a quantum of %d", quantum); }
 	printf(" scheduling...\n\n");
 
 	scheduler_start_up(cores, scheme);
 
+	if (scheme == MLFQ)
+	{
+		long long quanta[32];
+		int level;
+		for (level = 0; level < levels; level++)
+			quanta[level] = 1LL << level;
+		scheduler_set_mlfq(levels, quanta, boost);
+	}
+	else if (scheme == CFS || scheme == STRIDE || scheme == LOTTERY)
+		scheduler_set_quantum(quantum);
+
+
+	long long time = 0, span;
+	int i, j;
+	int job_count = job_id, active_jobs = job_id, jobs_alive = 0;
 
-	int time = 0, i, j;
-	int active_jobs = job_id, jobs_alive = 0;
+	long long *quantum_clock = malloc(cores * sizeof(long long));
+	int *running = malloc(cores * sizeof(int));
+	timeline_t *core_timing_diagram = calloc(cores, sizeof(timeline_t));
 
-	int *quantum_clock = malloc(cores * sizeof(int));
-	char **core_timing_diagram = malloc(cores * sizeof(char *));
-	int core_timing_diagram_size = 1024;
+	// -q leaves out the timing diagrams, unless -w asks for part of one
+	int draw_diagram = verbosity != SUMMARY || window_given;
 
 	for (i = 0; i < cores; i++)
 	{
 		quantum_clock[i] = -1;
-		core_timing_diagram[i] = malloc(core_timing_diagram_size + 1);
-		core_timing_diagram[i][0] = '\0';
+		running[i] = -1;
+	}
+
+	/*
+	 * Jobs stay where they were loaded, so jobs[job_id] is always job_id.
+	 * order[] lists the unfinished ones; see remove_job(). Arrivals are
+	 * found with a cursor into the jobs sorted by arrival time, and
+	 * finishes and expiries by looking at what each core is running, so
+	 * a time unit costs as much as its events rather than every job.
+	 */
+	int *order = malloc(job_count * sizeof(int));
+	int *batch = malloc((job_count > cores ? job_count : cores) * sizeof(int));
+	simulator_job_list_t **by_arrival = malloc(job_count * sizeof(simulator_job_list_t *));
+	int next_arrival = 0;
+
+	for (i = 0; i < job_count; i++)
+	{
+		order[i] = i;
+		by_arrival[i] = &jobs[i];
 	}
 
+	qsort(by_arrival, job_count, sizeof(simulator_job_list_t *), compare_arrival);
+
+	/*
+	 * With -e, time skips from one event to the next rather than going a
+	 * unit at a time. A heap holds, for each core, when its job next
+	 * finishes or has its quantum expire; the next arrival is the one
+	 * under the cursor. The scheduler is called exactly as it would be
+	 * otherwise; only the frames between events are left out.
+	 */
+	priqueue_t events;
+	long long *core_events = NULL;
+	priqueue_handle_t *core_handles = NULL;
+	int *touched = NULL, num_touched = 0;
+	char *is_touched = NULL;
+
+	if (events_only)
+	{
+		core_events = malloc(cores * sizeof(long long));
+		core_handles = malloc(cores * sizeof(priqueue_handle_t));
+		touched = malloc(cores * sizeof(int));
+		is_touched = calloc(cores, sizeof(char));
+
+		priqueue_init_kind(&events, NULL, PRIQUEUE_HEAP);
+		priqueue_set_key(&events, event_time);
+
+		for (i = 0; i < cores; i++)
+		{
+			core_events[i] = LLONG_MAX;
+			core_handles[i] = priqueue_offer_handle(&events, &core_events[i]);
+		}
+	}
+
+	long long printed_time = -1;
+
 	while (active_jobs > 0)
 	{
-		printf("=== [TIME %d] ===\n", time);
+		if (verbosity == FRAMES)
+			print_time(time, &printed_time);
 
 		/*
 		 * 1. Check if any jobs finished in the last time unit.
 		 */
-		for (i = 0; i < active_jobs; i++)
+		int finishing = 0;
+		for (i = 0; i < cores; i++)
+			if (running[i] != -1 && jobs[running[i]].run_time == 0)
+				batch[finishing++] = running[i];
+
+		while (finishing > 0)
 		{
-			if (jobs[i].run_time == 0)
+			// Finish them in the order they hold in order[], which each one changes
+			int first = 0;
+			for (j = 1; j < finishing; j++)
+				if (jobs[batch[j]].slot < jobs[batch[first]].slot)
+					first = j;
+
+			simulator_job_list_t *job = &jobs[batch[first]];
+			batch[first] = batch[--finishing];
+
+			// Notify the scheduler has finished
+			int job_id = job->job_id;
+			int core_id = job->core_id;
+			int new_job_id = scheduler_job_finished64(core_id, job_id, time);
+
+			quantum_clock[core_id] = next_quantum(scheme, quantum, core_id);
+			touch_core(core_id, touched, &num_touched, is_touched);
+
+			// Delete the finished jobs, decrease the number of active jobs
+			remove_job(job, jobs, order, active_jobs);
+			job->core_id = -1;
+			running[core_id] = -1;
+			active_jobs--;
+			jobs_alive--;
+
+			// Set the new job
+			if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, jobs, job_count, running) )
 			{
-				// Notify the scheduler has finished
-				int job_id = jobs[i].job_id;
-				int core_id = jobs[i].core_id;
-				int new_job_id = scheduler_job_finished(jobs[i].core_id, jobs[i].job_id, time);
-
-				if (scheme == RR)
-					quantum_clock[jobs[i].core_id] = quantum;
-
-				// Delete the finished jobs, decrease the number of active jobs
-				if (i != active_jobs - 1)
-					memcpy(&jobs[i], &jobs[active_jobs - 1], sizeof(simulator_job_list_t));
-				active_jobs--;
-				jobs_alive--;
-				i--;
-
-				// Set the new job
-				if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, jobs, active_jobs) )
-				{
-					printf("The scheduler_job_finished() selected an invalid job (job_id == %d).\n", new_job_id);
-					print_available_jobs(jobs, active_jobs);
-					return 3;
-				}
-				else
-				{
-					printf("Job %d, running on core %d, finished. Core %d is now running job %d.\n", job_id, core_id, core_id, new_job_id);
-					printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
-				}
+				printf("The scheduler_job_finished() selected an invalid job (job_id == %d).\n", new_job_id);
+				print_available_jobs(jobs, order, active_jobs);
+				return 3;
+			}
+			else if (verbosity >= EVENTS)
+			{
+				print_time(time, &printed_time);
+				printf("Job %d, running on core %d, finished. Core %d is now running job %d.\n", job_id, core_id, core_id, new_job_id);
+				printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
 			}
 		}
 
@@ -293,40 +681,35 @@ int main(int argc, char **argv)
 		/*
 		 * 2. Check of any quantums expired in the last time unit.
 		 */
-		if (scheme == RR)
+		if (scheme == RR || scheme == MLFQ || scheme == CFS || scheme == STRIDE || scheme == LOTTERY)
 		{
 			for (i = 0; i < cores; i++)
 			{
-				if (quantum_clock[i] == 0)
+				if (quantum_clock[i] == 0 && running[i] != -1)
 				{
-					for (j = 0; j < active_jobs; j++)
+					// Notify the scheduler the quantum has expired
+					int core_id = i;
+					int old_job_id = running[i];
+					int new_job_id = scheduler_quantum_expired64(core_id, time);
+
+					jobs[old_job_id].core_id = -1;
+					running[core_id] = -1;
+
+					quantum_clock[core_id] = next_quantum(scheme, quantum, core_id);
+					touch_core(core_id, touched, &num_touched, is_touched);
+
+					// Set the new job
+					if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, jobs, job_count, running) )
 					{
-						if (jobs[j].core_id == i)
-						{
-							// Notify the scheduler the quantum has expired
-							int core_id = jobs[j].core_id;
-							int old_job_id = jobs[j].job_id;
-							int new_job_id = scheduler_quantum_expired(jobs[j].core_id, time);
-
-							jobs[j].core_id = -1;
-
-							quantum_clock[core_id] = quantum;
-
-							// Set the new job
-							if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, jobs, active_jobs) )
-							{
-								printf("The scheduler_quantum_expired() selected an invalid job (job_id == %d).\n", new_job_id);
-								print_available_jobs(jobs, active_jobs);
-								return 3;
-							}
-							else
-							{
-								printf("Job %d, running on core %d, had its quantum expire. Core %d is now running job %d.\n", old_job_id, core_id, core_id, new_job_id);
-								printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
-							}
-
-							break;
-						}
+						printf("The scheduler_quantum_expired() selected an invalid job (job_id == %d).\n", new_job_id);
+						print_available_jobs(jobs, order, active_jobs);
+						return 3;
+					}
+					else if (verbosity >= EVENTS)
+					{
+						print_time(time, &printed_time);
+						printf("Job %d, running on core %d, had its quantum expire. Core %d is now running job %d.\n", old_job_id, core_id, core_id, new_job_id);
+						printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
 					}
 				}
 			}
@@ -336,118 +719,138 @@ int main(int argc, char **argv)
 		/*
 		 * 3. Check for any new jobs that arrive in this time unit
 		 */
-		for (i = 0; i < active_jobs; i++)
+		int arriving = 0;
+		while (next_arrival < job_count && by_arrival[next_arrival]->arrival_time <= time)
 		{
-			if (jobs[i].arrival_time == time)
+			if (by_arrival[next_arrival]->arrival_time == time)
+				batch[arriving++] = by_arrival[next_arrival]->job_id;
+			next_arrival++;
+		}
+
+		// Jobs arriving together come in the order they hold in order[]
+		for (i = 1; i < arriving; i++)
+			for (j = i; j > 0 && jobs[batch[j]].slot < jobs[batch[j - 1]].slot; j--)
 			{
-				int new_job_core_id = scheduler_new_job(jobs[i].job_id, time, jobs[i].run_time, jobs[i].priority);
-				jobs[i].arrived = 1;
-				jobs_alive++;
+				int swap = batch[j];
+				batch[j] = batch[j - 1];
+				batch[j - 1] = swap;
+			}
+
+		for (i = 0; i < arriving; i++)
+		{
+			simulator_job_list_t *job = &jobs[batch[i]];
+			int new_job_core_id = scheduler_new_job64(job->job_id, time, job->run_time, job->priority);
+			job->arrived = 1;
+			jobs_alive++;
 
-				if (new_job_core_id >= 0 && new_job_core_id < cores)
+			if (new_job_core_id >= 0 && new_job_core_id < cores)
+			{
+				if (verbosity >= EVENTS)
 				{
-					printf("A new job, job %d (running time=%d, priority=%d), arrived. Job %d is now running on core %d.\n",
-							jobs[i].job_id, jobs[i].run_time, jobs[i].priority, jobs[i].job_id, new_job_core_id);
+					print_time(time, &printed_time);
+					printf("A new job, job %d (running time=%lld, priority=%d), arrived. Job %d is now running on core %d.\n",
+							job->job_id, job->run_time, job->priority, job->job_id, new_job_core_id);
 					printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
+				}
 
-					// Find if anyone is currently using the core.
-					for (j = 0; j < active_jobs; j++)
-						if (jobs[j].core_id == new_job_core_id)
-							jobs[j].core_id = -1;
-
-					// Assign the core to the new job
-					jobs[i].core_id = new_job_core_id;
+				// Assign the core to the new job, taking it from anyone using it
+				set_active_job(job->job_id, new_job_core_id, jobs, job_count, running);
 
-					if (scheme == RR)
-						quantum_clock[new_job_core_id] = quantum;
-				}
-				else if (new_job_core_id == -1)
+				quantum_clock[new_job_core_id] = next_quantum(scheme, quantum, new_job_core_id);
+				touch_core(new_job_core_id, touched, &num_touched, is_touched);
+			}
+			else if (new_job_core_id == -1)
+			{
+				if (verbosity >= EVENTS)
 				{
-					printf("A new job, job %d (running time=%d, priority=%d), arrived. Job %d is set to idle (-1).\n",
-							jobs[i].job_id, jobs[i].run_time, jobs[i].priority, jobs[i].job_id);
+					print_time(time, &printed_time);
+					printf("A new job, job %d (running time=%lld, priority=%d), arrived. Job %d is set to idle (-1).\n",
+							job->job_id, job->run_time, job->priority, job->job_id);
 					printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
 				}
-				else
-				{
-					printf("The scheduler_new_job() selected an invalid core (core_id == %d).\n", new_job_core_id);
-					print_available_cores(cores);
-					return 3;
-				}
+			}
+			else
+			{
+				printf("The scheduler_new_job() selected an invalid core (core_id == %d).\n", new_job_core_id);
+				print_available_cores(cores);
+				return 3;
 			}
 		}
 
 
 		/*
-		 * 4. Run the time unit.
+		 * 4. Run the time unit, or with -e every unit up to the next event.
 		 */
-		char time_string[cores][11];
-		int cores_working = 0;
+		span = 1;
 
-		for (i = 0; i < cores; i++)
-			time_string[i][0] = '\0';
-
-		for (i = 0; i < active_jobs; i++)
+		if (events_only)
 		{
-			if (jobs[i].core_id != -1)
+			for (j = 0; j < num_touched; j++)
 			{
-				cores_working++;
-				jobs[i].run_time--;
-				quantum_clock[jobs[i].core_id]--;
-
-				assert(time_string[jobs[i].core_id][0] == '\0');
-
-				if (jobs[i].job_id < 10)
-					sprintf(time_string[jobs[i].core_id], "%d", jobs[i].job_id);
-				else if (jobs[i].job_id < 10 + 26)
-					sprintf(time_string[jobs[i].core_id], "%c", jobs[i].job_id - 10 + 'a');
-				else if (jobs[i].job_id < 10 + 26 + 26)
-					sprintf(time_string[jobs[i].core_id], "%c", jobs[i].job_id - 10 - 26 + 'A');
-				else
-					snprintf(time_string[jobs[i].core_id], 10, "(%d)", jobs[i].job_id);
+				i = touched[j];
+				is_touched[i] = 0;
+				core_events[i] = LLONG_MAX;
+
+				if (running[i] != -1)
+				{
+					core_events[i] = time + jobs[running[i]].run_time;
+					if (quantum_clock[i] > 0 && quantum_clock[i] < jobs[running[i]].run_time)
+						core_events[i] = time + quantum_clock[i];
+				}
+
+				priqueue_update_key(&events, core_handles[i]);
 			}
+			num_touched = 0;
+
+			long long next = event_time(priqueue_peek(&events));
+			if (next_arrival < job_count && by_arrival[next_arrival]->arrival_time < next)
+				next = by_arrival[next_arrival]->arrival_time;
+
+			if (next != LLONG_MAX)
+				span = next - time;
 		}
 
+		int cores_working = 0;
+
 		for (i = 0; i < cores; i++)
 		{
-			// If the core is idle, print a '-'
-			if (time_string[i][0] == '\0')
-				strcpy(time_string[i], "-");
-
-			// Ensure we have enough memory
-			while (strlen(core_timing_diagram[i]) + strlen(time_string[i]) >= (unsigned int)core_timing_diagram_size)
+			if (running[i] != -1)
 			{
-				core_timing_diagram_size *= 2;
-
-				for (j = 0; j < cores; j++)
-				{
-					core_timing_diagram[j] = realloc(core_timing_diagram[j], core_timing_diagram_size + 1);
-
-					if (core_timing_diagram[j] == NULL)
-					{
-						fprintf(stderr, "Out of memory.\n");
-						return 3;
-					}
-				}
+				cores_working++;
+				jobs[running[i]].run_time -= span;
+				quantum_clock[i] -= span;
 			}
 
-			strcat( core_timing_diagram[i], time_string[i] );
+			// An idle core is recorded as job -1, drawn as '-'
+			if (draw_diagram && !timeline_add(&core_timing_diagram[i], running[i], span))
+			{
+				fprintf(stderr, "Out of memory.\n");
+				return 3;
+			}
 		}
 
 
 		/*
 		 * 5. Print data!
 		 */
-		printf("At the end of time unit %d...\n", time);
+		if (verbosity == FRAMES)
+		{
+			printf("At the end of time unit %lld...\n", time + span - 1);
 
-		for (i = 0; i < cores; i++)
-			printf("  Core %2d: %s\n", i, core_timing_diagram[i]);
+			for (i = 0; i < cores; i++)
+			{
+				printf("  Core %2d: ", i);
+				timeline_print(&core_timing_diagram[i], window_start, window_end);
+				printf("\n");
+			}
 
-		printf("\n");
+			printf("\n");
 
-		printf("  Queue: ");
-		scheduler_show_queue();
-		printf("\n");
-		printf("\n");
+			printf("  Queue: ");
+			scheduler_show_queue();
+			printf("\n");
+			printf("\n");
+		}
 
 
 		/*
@@ -458,7 +861,7 @@ int main(int argc, char **argv)
 		if (jobs_alive > 0 && cores_working == 0)
 		{
 			printf("All cores are idle and at least one job remains unscheduled.\n");
-			print_available_jobs(jobs, active_jobs);
+			print_available_jobs(jobs, order, active_jobs);
 			return 3;
 		}
 
@@ -466,25 +869,57 @@ int main(int argc, char **argv)
 		/*
 		 * 7. Increase time
 		 */
-		time++;
+		time += span;
 	}
 
 
-	printf("FINAL TIMING DIAGRAM:\n");
-	for (i = 0; i < cores; i++)
-		printf("  Core %2d: %s\n", i, core_timing_diagram[i]);
-
+	/*
+	 * The tail of the output is what gets compared against the examples,
+	 * so the percentiles come before the final timing diagram.
+	 */
+	printf("LATENCY PERCENTILES:\n");
+	printf("                       p50     p90     p99    p999     max\n");
+	print_percentiles("Waiting Time", scheduler_percentile_waiting_time64);
+	print_percentiles("Turnaround Time", scheduler_percentile_turnaround_time64);
+	print_percentiles("Response Time", scheduler_percentile_response_time64);
 	printf("\n");
-	printf("Average Waiting Time: %.2f\n", scheduler_average_waiting_time());
-	printf("Average Turnaround Time: %.2f\n", scheduler_average_turnaround_time());
-	printf("Average Response Time: %.2f\n", scheduler_average_response_time());
+
+	if (draw_diagram)
+	{
+		printf("FINAL TIMING DIAGRAM:\n");
+		for (i = 0; i < cores; i++)
+		{
+			printf("  Core %2d: ", i);
+			timeline_print(&core_timing_diagram[i], window_start, window_end);
+			printf("\n");
+		}
+
+		printf("\n");
+	}
+	//Through float, so halfway values round as they always have.
+	printf("Average Waiting Time: %.2f\n", (float) scheduler_average_waiting_time64());
+	printf("Average Turnaround Time: %.2f\n", (float) scheduler_average_turnaround_time64());
+	printf("Average Response Time: %.2f\n", (float) scheduler_average_response_time64());
 
 	scheduler_clean_up();
 
 
+	if (events_only)
+	{
+		priqueue_destroy(&events);
+		free(core_events);
+		free(core_handles);
+		free(touched);
+		free(is_touched);
+	}
+
 	free(quantum_clock);
+	free(running);
+	free(order);
+	free(batch);
+	free(by_arrival);
 	for (i=0; i < cores; i++)
-		free(core_timing_diagram[i]);
+		free(core_timing_diagram[i].segments);
 	free(core_timing_diagram);
 	free(jobs);
 
@@ -0,0 +1,103 @@
+/** @file tracecvt.c
+ *
+ * Converts a CSV trace into the binary format of libtrace, which the
+ * simulator maps and reads in place, or with -t a trace of either kind
+ * back into CSV.
+ *
+ * Usage: ./tracecvt [-t] <input file> <output file>
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "libtrace/libtrace.h"
+
+void print_usage(char *program_name)
+{
+	fprintf(stderr, "Usage: %s [-t] <input file> <output file>\n", program_name);
+	fprintf(stderr, "       %s examples/proc1.csv proc1.trace\n", program_name);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Writes a binary trace, or a CSV one with -t.\n");
+}
+
+
+int main(int argc, char **argv)
+{
+	int c, text = 0;
+
+	while ((c = getopt(argc, argv, "t")) != -1)
+	{
+		switch (c)
+		{
+			case 't':
+				text = 1;
+				break;
+
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (argc - optind != 2)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	trace_t trace;
+	int result = trace_open(&trace, argv[optind]);
+	if (result == -1)
+	{
+		fprintf(stderr, "Unable to open file \"%s\".\n", argv[optind]);
+		return 2;
+	}
+	else if (result == -2)
+	{
+		fprintf(stderr, "Illegal file format.\n");
+		return 2;
+	}
+
+	FILE *file = fopen(argv[optind + 1], "wb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Unable to open file \"%s\".\n", argv[optind + 1]);
+		return 2;
+	}
+
+	static char buffer[1 << 20];
+	setvbuf(file, buffer, _IOFBF, sizeof(buffer));
+
+	long long arrival_time, run_time;
+	int priority, written;
+
+	if (text)
+		written = fprintf(file, "\"Arrival time\",\"Run time\",\"Priority\"\n") > 0;
+	else
+		written = trace_write_header(file, trace_count(&trace));
+
+	while (written && (result = trace_next(&trace, &arrival_time, &run_time, &priority)) == 1)
+	{
+		if (text)
+			written = fprintf(file, "%lld,%lld,%d\n", arrival_time, run_time, priority) > 0;
+		else
+			written = trace_write_record(file, arrival_time, run_time, priority);
+	}
+
+	trace_close(&trace);
+
+	if (result == -1)
+	{
+		fprintf(stderr, "Illegal file format.\n");
+		fclose(file);
+		return 2;
+	}
+
+	if (fclose(file) != 0 || !written)
+	{
+		fprintf(stderr, "Unable to write file \"%s\".\n", argv[optind + 1]);
+		return 2;
+	}
+
+	return 0;
+}